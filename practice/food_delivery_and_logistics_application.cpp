@@ -2,6 +2,36 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <tuple>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -13,7 +43,8 @@ using namespace std;
 class Edge {
 public:
     int u, v, weight;  // u: source node, v: destination node, weight: delivery cost
-    Edge(int u, int v, int weight) : u(u), v(v), weight(weight) {}
+    int profile;       // Time-of-day cost profile id (-1: weight applies all day)
+    Edge(int u, int v, int weight, int profile = -1) : u(u), v(v), weight(weight), profile(profile) {}
     
     // Operator overloading for sorting edges by weight (ascending order)
     // Time Complexity: O(1)
@@ -74,71 +105,519 @@ class Order {
 public:
     int id;       // Unique order identifier
     int priority; // Priority level (higher = more urgent)
-    Order(int id, int priority) : id(id), priority(priority) {}
+    int node;     // Delivery location (-1 if not yet known)
+    Order() : id(-1), priority(-1), node(-1) {}  // Placeholder for buffers
+    Order(int id, int priority, int node = -1) : id(id), priority(priority), node(node) {}
+};
+
+// ----------- Order Pool -----------
+/**
+ * Slab allocator for Order payloads with generation-checked handles
+ * Orders live in fixed 4096-entry slabs, so their addresses never move
+ * and freed slots are recycled through a free list. A handle packs the
+ * slot index (low 32 bits) with the slot's generation (high 32 bits):
+ * releasing a slot bumps its generation, so stale handles are detected
+ * instead of silently reading a recycled order
+ */
+typedef uint64_t OrderHandle;  // Compact 64-bit order reference
+const OrderHandle INVALID_ORDER_HANDLE = ~0ULL;
+
+class OrderPool {
+private:
+    static const uint32_t SLAB_SIZE = 4096;
+    vector<unique_ptr<Order[]>> slabs;
+    vector<uint32_t> generation;  // generation[slot]: bumped on every release
+    vector<uint32_t> freeSlots;   // Released slots, reused LIFO (still warm in cache)
+
+public:
+    static uint32_t slotOf(OrderHandle h) { return (uint32_t)h; }
+
+    OrderHandle handleOf(uint32_t slot) const {
+        return (OrderHandle)generation[slot] << 32 | slot;
+    }
+
+    // Store an order and return its slot. Time Complexity: O(1) amortized
+    uint32_t allocate(const Order& o) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = generation.size();
+            if (slot % SLAB_SIZE == 0) slabs.emplace_back(new Order[SLAB_SIZE]);
+            generation.push_back(0);
+        }
+        at(slot) = o;
+        return slot;
+    }
+
+    // Unchecked access by slot
+    Order& at(uint32_t slot) { return slabs[slot / SLAB_SIZE][slot % SLAB_SIZE]; }
+    const Order& at(uint32_t slot) const { return slabs[slot / SLAB_SIZE][slot % SLAB_SIZE]; }
+
+    // Checked access: nullptr if the handle's order was already released
+    const Order* find(OrderHandle h) const {
+        uint32_t slot = slotOf(h);
+        if (slot >= generation.size() || generation[slot] != (uint32_t)(h >> 32)) return nullptr;
+        return &at(slot);
+    }
+
+    void release(uint32_t slot) {
+        generation[slot]++;  // Invalidates every outstanding handle to this slot
+        freeSlots.push_back(slot);
+    }
 };
 
 // ----------- Max Heap for Orders -----------
 /**
  * Max Heap implementation for priority queue of orders
  * Processes orders based on priority (highest priority first)
+ * Order payloads live in an OrderPool; the heap array holds only 8-byte
+ * keys (priority in the high 32 bits, pool slot in the low 32 bits), so
+ * sifts compare and move single integers however large Order grows
  * Time Complexity: Insert O(log n), Extract O(log n)
  */
 class MaxHeap {
 private:
-    vector<Order> heap;  // Dynamic array to store heap elements
+    vector<uint64_t> heap;  // Dynamic array of keys, ordered as unsigned integers
+    OrderPool pool;         // Order payloads referenced by the keys
+
+    // Flipping the sign bit makes signed priorities order correctly as unsigned
+    static uint64_t keyOf(int priority, uint32_t slot) {
+        return (uint64_t)((uint32_t)priority ^ 0x80000000u) << 32 | slot;
+    }
+    static uint32_t slotOfKey(uint64_t key) { return (uint32_t)key; }
 
     // Heapify up: Restore heap property after insertion
-    // Moves newly inserted element up until heap property is satisfied
+    // Moves newly inserted key up until heap property is satisfied
+    // (parents are shifted down into the hole, the key is written once)
     void heapifyUp(int index) {
-        while (index > 0 && heap[index].priority > heap[(index - 1) / 2].priority) {
-            swap(heap[index], heap[(index - 1) / 2]);  // Swap with parent
-            index = (index - 1) / 2;  // Move to parent position
+        uint64_t key = heap[index];
+        while (index > 0 && key > heap[(index - 1) / 2]) {
+            heap[index] = heap[(index - 1) / 2];  // Move parent down
+            index = (index - 1) / 2;              // Move to parent position
         }
+        heap[index] = key;
     }
 
     // Heapify down: Restore heap property after extraction
-    // Moves root element down until heap property is satisfied
+    // Moves the key at index down until heap property is satisfied
     void heapifyDown(int index) {
         int size = heap.size();
+        uint64_t key = heap[index];
         while (2 * index + 1 < size) {  // While node has at least left child
-            int largest = index;
-            int left = 2 * index + 1;
-            int right = 2 * index + 2;
-
-            // Find largest among node and its children
-            if (left < size && heap[left].priority > heap[largest].priority)
-                largest = left;
-            if (right < size && heap[right].priority > heap[largest].priority)
-                largest = right;
-
-            // If largest is not current node, swap and continue
-            if (largest != index) {
-                swap(heap[index], heap[largest]);
-                index = largest;
-            } else break;  // Heap property satisfied
+            int largest = 2 * index + 1;
+            // Pick the larger child
+            if (largest + 1 < size && heap[largest + 1] > heap[largest]) largest++;
+            if (heap[largest] <= key) break;  // Heap property satisfied
+            heap[index] = heap[largest];      // Move child up
+            index = largest;
         }
+        heap[index] = key;
     }
 
 public:
     // Insert order into heap and maintain max heap property
-    void insert(Order o) {
-        heap.push_back(o);           // Add to end of array
-        heapifyUp(heap.size() - 1);  // Restore heap property
+    // Returns a handle that stays valid until the order is extracted
+    OrderHandle insert(Order o) {
+        uint32_t slot = pool.allocate(o);
+        heap.push_back(keyOf(o.priority, slot));  // Add to end of array
+        heapifyUp(heap.size() - 1);               // Restore heap property
+        return pool.handleOf(slot);
+    }
+
+    // Insert many orders at once
+    // Small batches sift each order up: O(k log n)
+    // Large batches (k > n / 4) rebuild bottom-up with Floyd's heapify: O(n + k)
+    void insertBatch(const vector<Order>& orders) {
+        size_t before = heap.size();
+        for (const Order& o : orders) heap.push_back(keyOf(o.priority, pool.allocate(o)));
+        if (orders.size() > before / 4) {
+            for (int i = (int)heap.size() / 2 - 1; i >= 0; --i) heapifyDown(i);
+        } else {
+            for (size_t i = before; i < heap.size(); ++i) heapifyUp(i);
+        }
+    }
+
+    // Extract order with maximum priority into `out`; false if the heap is empty
+    bool tryExtractMax(Order& out) {
+        if (heap.empty()) return false;
+        uint32_t slot = slotOfKey(heap[0]);
+        out = pool.at(slot);         // Copy the payload out of the pool
+        pool.release(slot);
+        heap[0] = heap.back();       // Move last key to root
+        heap.pop_back();             // Remove last key
+        if (!heap.empty()) heapifyDown(0);  // Restore heap property from root
+        return true;
     }
 
     // Extract order with maximum priority
+    // Returns the Order() placeholder (id -1) if empty; prefer tryExtractMax
     Order extractMax() {
-        if (heap.empty()) return Order(-1, -1);  // Return invalid order if empty
-        Order top = heap[0];         // Store maximum element
-        heap[0] = heap.back();       // Move last element to root
-        heap.pop_back();             // Remove last element
-        heapifyDown(0);              // Restore heap property from root
+        Order top;
+        tryExtractMax(top);
         return top;
     }
 
-    bool isEmpty() {
+    bool isEmpty() const {
         return heap.empty();
     }
+
+    int size() const {
+        return heap.size();
+    }
+
+    // Highest priority order without removing it (heap must not be empty)
+    const Order& peekMax() const {
+        return pool.at(slotOfKey(heap[0]));
+    }
+
+    // Pending order behind a handle returned by insert (nullptr once extracted)
+    const Order* find(OrderHandle handle) const {
+        return pool.find(handle);
+    }
+};
+
+// ----------- Order Journal (Write-Ahead Log) -----------
+/**
+ * Append-only journal of order heap events for crash recovery
+ * - Fixed 32-byte binary records: one per addOrder / extracted order
+ * - Recording only copies the record into an in-memory batch under a mutex
+ * - A background thread checksums each batch (CRC-32), writes it with one
+ *   write() and makes it durable with one fdatasync() (group commit)
+ * - On open, valid records are replayed (stopping at a torn or corrupt
+ *   tail), the surviving orders are kept for a bulk heapify, and the file is
+ *   rewritten to contain only those orders so it does not grow across restarts
+ * - A failed write or fdatasync truncates the file back to the last commit
+ *   and stops journaling: nothing is appended after a torn batch, and sync()
+ *   throws instead of reporting the lost records as durable
+ */
+class OrderJournal {
+private:
+    enum RecordType : uint32_t { ADD = 1, EXTRACT = 2 };
+
+    struct Record {
+        uint64_t sequence;  // Monotonic record number
+        uint32_t type;      // ADD or EXTRACT
+        int32_t orderId;
+        int32_t priority;
+        int32_t node;
+        uint32_t reserved;
+        uint32_t checksum;  // CRC-32 of the preceding 28 bytes
+    };
+    static_assert(sizeof(Record) == 32, "journal records must stay 32 bytes");
+
+    string path;
+    int fd = -1;
+    chrono::microseconds commitInterval;   // Max time a record waits for its group commit
+    mutex lock;                            // Guards pending / nextSequence / durableSequence
+    condition_variable commitWanted;       // Wakes the flusher early (batch full or sync())
+    condition_variable committed;          // Wakes sync() callers after a commit
+    vector<Record> pending;                // Recorded but not yet written
+    uint64_t nextSequence = 1;
+    uint64_t durableSequence = 0;          // Every record up to here is on disk
+    bool stopping = false;
+    bool syncRequested = false;            // A sync() caller is waiting: commit now
+    bool failed = false;                   // A commit failed: journaling has stopped
+    off_t committedBytes = 0;              // File size after the last successful commit
+    vector<Order> recovered;               // Live orders found at open
+    thread flusher;
+    static const size_t GROUP_LIMIT = 4096;  // Commit early once this many records wait
+
+    static uint32_t crc32(const void* data, size_t length) {
+        static const auto table = [] {
+            array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; ++i) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    static uint32_t checksumOf(const Record& r) {
+        return crc32(&r, offsetof(Record, checksum));
+    }
+
+    static bool writeAll(int fd, const void* data, size_t length) {
+        const char* bytes = static_cast<const char*>(data);
+        while (length > 0) {
+            ssize_t written = ::write(fd, bytes, length);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            bytes += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    // Replay the existing file into `recovered`, then atomically replace it
+    // with a compact journal holding one ADD per surviving order
+    void recover() {
+        vector<Order> live;
+        // Order id -> positions in `live`; ids need not be unique, so each
+        // live copy keeps its own slot
+        unordered_multimap<int, size_t> slotsOf;
+        int in = ::open(path.c_str(), O_RDONLY);
+        if (in >= 0) {
+            vector<Record> chunk(8192);
+            bool valid = true;
+            while (valid) {
+                ssize_t got = ::read(in, chunk.data(), chunk.size() * sizeof(Record));
+                if (got <= 0) break;
+                size_t records = got / sizeof(Record);  // A partial trailing record is a torn write
+                for (size_t i = 0; i < records && valid; ++i) {
+                    const Record& r = chunk[i];
+                    if (r.checksum != checksumOf(r)) { valid = false; break; }
+                    nextSequence = r.sequence + 1;
+                    if (r.type == ADD) {
+                        slotsOf.emplace(r.orderId, live.size());
+                        live.push_back(Order(r.orderId, r.priority, r.node));
+                    } else if (r.type == EXTRACT) {
+                        auto [first, last] = slotsOf.equal_range(r.orderId);
+                        if (first == last) continue;
+                        // Remove the copy the extract describes (same priority and node), else any copy
+                        auto pick = first;
+                        for (auto it = first; it != last; ++it)
+                            if (live[it->second].priority == r.priority && live[it->second].node == r.node) { pick = it; break; }
+                        size_t slot = pick->second, moved = live.size() - 1;
+                        slotsOf.erase(pick);
+                        if (slot != moved) {  // Swap-remove, fixing the moved order's slot
+                            live[slot] = live.back();
+                            auto [from, to] = slotsOf.equal_range(live[slot].id);
+                            for (auto it = from; it != to; ++it)
+                                if (it->second == moved) { it->second = slot; break; }
+                        }
+                        live.pop_back();
+                    }
+                }
+                if ((size_t)got % sizeof(Record) != 0) break;
+            }
+            ::close(in);
+        }
+
+        string compactPath = path + ".compact";
+        int out = ::open(compactPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0) throw runtime_error("cannot create journal " + compactPath);
+        vector<Record> records;
+        records.reserve(live.size());
+        for (const Order& o : live) {
+            Record r{nextSequence++, ADD, o.id, o.priority, o.node, 0, 0};
+            r.checksum = checksumOf(r);
+            records.push_back(r);
+        }
+        if (!writeAll(out, records.data(), records.size() * sizeof(Record)) || ::fdatasync(out) != 0)
+            throw runtime_error("cannot write journal " + compactPath);
+        ::close(out);
+        if (::rename(compactPath.c_str(), path.c_str()) != 0)
+            throw runtime_error("cannot replace journal " + path);
+        durableSequence = nextSequence - 1;
+        recovered = move(live);
+    }
+
+    void flushLoop() {
+        vector<Record> batch;
+        unique_lock<mutex> guard(lock);
+        for (;;) {
+            commitWanted.wait_for(guard, commitInterval,
+                                  [&] { return stopping || syncRequested || pending.size() >= GROUP_LIMIT; });
+            syncRequested = false;
+            if (failed) pending.clear();  // Nothing more can be made durable
+            if (pending.empty()) {
+                if (stopping) return;
+                continue;
+            }
+            batch.swap(pending);
+            uint64_t last = batch.back().sequence;
+            guard.unlock();
+
+            // Checksums are computed here, off the recording path
+            for (Record& r : batch) r.checksum = checksumOf(r);
+            size_t bytes = batch.size() * sizeof(Record);
+            bool ok = writeAll(fd, batch.data(), bytes) && ::fdatasync(fd) == 0;
+            if (!ok) {
+                // Cut off any torn bytes so recovery still reaches every committed record
+                if (::ftruncate(fd, committedBytes) != 0 || ::fdatasync(fd) != 0)
+                    cerr << "order journal: cannot truncate " << path << " after a failed write\n";
+                cerr << "order journal: write to " << path << " failed, journaling stopped\n";
+            }
+            batch.clear();
+
+            guard.lock();
+            if (ok) {
+                committedBytes += bytes;
+                durableSequence = last;
+            } else {
+                failed = true;
+            }
+            committed.notify_all();
+        }
+    }
+
+    void append(RecordType type, const Order& o) {
+        lock_guard<mutex> guard(lock);
+        pending.push_back({nextSequence++, type, o.id, o.priority, o.node, 0, 0});
+        if (pending.size() == GROUP_LIMIT) commitWanted.notify_one();
+    }
+
+public:
+    // Open (or create) the journal at `path`, recovering any orders it holds
+    // commitInterval bounds how long a record waits before its fdatasync
+    explicit OrderJournal(const string& path, chrono::microseconds commitInterval = chrono::microseconds(2000))
+        : path(path), commitInterval(commitInterval) {
+        recover();
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if (fd < 0) throw runtime_error("cannot open journal " + path);
+        committedBytes = ::lseek(fd, 0, SEEK_END);
+        flusher = thread(&OrderJournal::flushLoop, this);
+    }
+
+    // Commits everything still pending before closing
+    ~OrderJournal() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        commitWanted.notify_one();
+        flusher.join();
+        ::close(fd);
+    }
+
+    OrderJournal(const OrderJournal&) = delete;
+    OrderJournal& operator=(const OrderJournal&) = delete;
+
+    // Orders that were still pending when the journal was last closed (or crashed)
+    const vector<Order>& recoveredOrders() const { return recovered; }
+
+    // Time Complexity: O(1), no I/O on the caller's thread
+    void recordAdd(const Order& o) { append(ADD, o); }
+    void recordExtract(const Order& o) { append(EXTRACT, o); }
+
+    // Block until every record made so far is durable
+    // Throws runtime_error if a commit failed, as those records never will be
+    void sync() {
+        unique_lock<mutex> guard(lock);
+        uint64_t target = nextSequence - 1;
+        if (durableSequence >= target) return;
+        syncRequested = true;
+        commitWanted.notify_one();
+        committed.wait(guard, [&] { return durableSequence >= target || failed; });
+        if (durableSequence < target) throw runtime_error("order journal " + path + " failed, records are not durable");
+    }
+
+    // False once a commit has failed and journaling has stopped
+    bool healthy() {
+        lock_guard<mutex> guard(lock);
+        return !failed;
+    }
+};
+
+// ----------- Lock-Free MPMC Ring Buffer -----------
+/**
+ * Bounded multi-producer / multi-consumer queue (Dmitry Vyukov's design)
+ * Each slot carries a sequence number telling producers and consumers
+ * whose turn it is, so a push or pop is one CAS on the shared position
+ * plus a release store on the slot. Slots are padded to a cache line so
+ * neighbouring producers/consumers do not false-share
+ * tryPush / tryPop never block: they fail immediately when full / empty
+ */
+template <class T>
+class MpmcRingBuffer {
+private:
+    static const size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Cell {
+        atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+        T* value() { return reinterpret_cast<T*>(storage); }
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(CACHE_LINE) atomic<size_t> enqueuePos{0};  // Producers and consumers on separate lines
+    alignas(CACHE_LINE) atomic<size_t> dequeuePos{0};
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpmcRingBuffer(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    ~MpmcRingBuffer() {
+        T discarded;
+        while (tryPop(discarded)) {}  // Destroy anything still queued
+    }
+
+    MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+    MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // Returns false (without waiting) if the buffer is full
+    bool tryPush(const T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                // Slot is free for this lap: claim it
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    new (cell.storage) T(value);
+                    cell.sequence.store(pos + 1, memory_order_release);  // Publish to consumers
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Slot still holds last lap's value: full
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);  // Another producer won, retry
+            }
+        }
+    }
+
+    // Returns false (without waiting) if the buffer is empty
+    bool tryPop(T& out) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    out = move(*cell.value());
+                    cell.value()->~T();
+                    cell.sequence.store(pos + mask + 1, memory_order_release);  // Free for next lap
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Nothing published yet: empty
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Pop up to maxItems values onto the end of `out`; returns how many were taken
+    size_t popBatch(vector<T>& out, size_t maxItems) {
+        size_t taken = 0;
+        T value;
+        while (taken < maxItems && tryPop(value)) {
+            out.push_back(move(value));
+            taken++;
+        }
+        return taken;
+    }
 };
 
 // ----------- KMP String Matching Algorithm -----------
@@ -189,128 +668,2915 @@ public:
     }
 };
 
-// ----------- Core Delivery Network System -----------
+// ----------- Geometry for Delivery Locations -----------
 /**
- * Main system integrating all algorithms:
- * 1. Kruskal's MST for minimum cost network construction
- * 2. Max Heap for priority-based order processing
- * 3. KMP for intelligent menu recommendation
+ * 2D coordinate of a delivery location, restaurant or courier
+ * Units are whatever the map uses (e.g. metres in a projected city grid)
  */
-class DeliveryNetwork {
+struct Point {
+    double x, y;
+};
+
+// Squared Euclidean distance (avoids sqrt when only comparing distances)
+inline double squaredDistance(const Point& a, const Point& b) {
+    double dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+// ----------- Uniform Grid Spatial Index -----------
+/**
+ * Uniform grid bucketing points into square cells
+ * Designed for moving objects (couriers): a position update is O(1)
+ * because each id remembers its cell and its slot inside that cell
+ * Queries expand ring by ring around the query cell and stop as soon as
+ * no unvisited ring can contain a closer point
+ */
+class UniformGrid {
 private:
-    int numNodes;                    // Number of delivery locations
-    vector<Edge> edges;              // All possible delivery routes
-    MaxHeap orderHeap;              // Priority queue for order management
-    vector<string> menuItems;       // Available menu items for recommendation
+    double minX, minY, cellSize;     // Grid origin and cell edge length
+    int cols, rows;                  // Grid dimensions in cells
+    vector<vector<int>> cells;       // cells[c]: ids currently inside cell c
+    vector<Point> position;          // position[id]: last reported position
+    vector<int> cellOf;              // cellOf[id]: cell index, -1 if not present
+    vector<int> slotOf;              // slotOf[id]: index of id inside cells[cellOf[id]]
+    int count = 0;                   // Number of ids currently stored
+
+    // Column/row of a coordinate, clamped to the grid so that points outside
+    // the service area still land in a border cell (distances stay exact)
+    int colOf(double x) const {
+        int c = (int)floor((x - minX) / cellSize);
+        return c < 0 ? 0 : (c >= cols ? cols - 1 : c);
+    }
+    int rowOf(double y) const {
+        int r = (int)floor((y - minY) / cellSize);
+        return r < 0 ? 0 : (r >= rows ? rows - 1 : r);
+    }
+
+    // Lower bound on the distance from q to any point in ring `ring` around
+    // cell (cx, cy): distance from q to the border of the inner (ring-1) box
+    double ringLowerBound(const Point& q, int cx, int cy, int ring) const {
+        double qx = min(max(q.x, minX), minX + cols * cellSize);  // Clamp like the points
+        double qy = min(max(q.y, minY), minY + rows * cellSize);
+        double left = qx - (minX + (cx - ring + 1) * cellSize);
+        double right = (minX + (cx + ring) * cellSize) - qx;
+        double down = qy - (minY + (cy - ring + 1) * cellSize);
+        double up = (minY + (cy + ring) * cellSize) - qy;
+        return max(0.0, min(min(left, right), min(down, up)));
+    }
+
+    // Visit every id in ring `ring` around (cx, cy) (ring 0 is the cell itself)
+    template <class Visitor>
+    void visitRing(int cx, int cy, int ring, Visitor&& visit) const {
+        int x0 = cx - ring, x1 = cx + ring, y0 = cy - ring, y1 = cy + ring;
+        for (int y = max(y0, 0); y <= min(y1, rows - 1); ++y) {
+            bool edgeRow = (y == y0 || y == y1);
+            // Inner rows only contribute their two border cells
+            int step = edgeRow ? 1 : max(x1 - x0, 1);
+            for (int x = x0; x <= x1; x += step) {
+                if (x < 0 || x >= cols) continue;
+                for (int id : cells[y * cols + x]) visit(id);
+            }
+        }
+    }
 
 public:
-    DeliveryNetwork(int numNodes) : numNodes(numNodes) {}
+    UniformGrid() : minX(0), minY(0), cellSize(1), cols(1), rows(1), cells(1) {}
 
-    // Add delivery route with optional promotional discount
-    // Promotional routes get 20% cost reduction
-    void addRoute(int u, int v, int cost, bool hasPromo = false) {
-        if (hasPromo) cost = cost * 0.8;  // Apply 20% discount for promotional routes
-        edges.push_back(Edge(u, v, cost));
+    // Grid covering [minX, maxX] x [minY, maxY] with square cells of cellSize
+    UniformGrid(double minX, double minY, double maxX, double maxY, double cellSize)
+        : minX(minX), minY(minY), cellSize(cellSize) {
+        cols = max(1, (int)ceil((maxX - minX) / cellSize));
+        rows = max(1, (int)ceil((maxY - minY) / cellSize));
+        cells.assign((size_t)cols * rows, vector<int>());
     }
 
-    // Add order to priority queue for processing
-    void addOrder(int id, int priority) {
-        orderHeap.insert(Order(id, priority));
+    // Insert id at p, or move it there if already present
+    // Time Complexity: O(1) amortized (a swap-remove from the old cell)
+    void update(int id, Point p) {
+        if (id >= (int)cellOf.size()) {
+            cellOf.resize(id + 1, -1);
+            slotOf.resize(id + 1, -1);
+            position.resize(id + 1);
+        }
+        int target = rowOf(p.y) * cols + colOf(p.x);
+        position[id] = p;
+        if (cellOf[id] == target) return;  // Moved within the same cell
+        if (cellOf[id] != -1) remove(id);
+        cellOf[id] = target;
+        slotOf[id] = cells[target].size();
+        cells[target].push_back(id);
+        count++;
     }
 
-    // Process all orders in priority order (highest priority first)
-    // Uses max heap to ensure optimal order processing sequence
-    void processOrders() {
-        cout << "\nProcessing Orders by Priority:\n";
-        while (!orderHeap.isEmpty()) {
-            Order o = orderHeap.extractMax();  // Get highest priority order
-            cout << "Order ID: " << o.id << ", Priority: " << o.priority << "\n";
+    // Remove id from the grid (no-op if absent)
+    void remove(int id) {
+        if (id < 0 || id >= (int)cellOf.size() || cellOf[id] == -1) return;
+        vector<int>& bucket = cells[cellOf[id]];
+        int last = bucket.back();
+        bucket[slotOf[id]] = last;  // Swap-remove keeps the bucket dense
+        slotOf[last] = slotOf[id];
+        bucket.pop_back();
+        cellOf[id] = -1;
+        count--;
+    }
+
+    bool contains(int id) const {
+        return id >= 0 && id < (int)cellOf.size() && cellOf[id] != -1;
+    }
+
+    int size() const { return count; }
+
+    // One past the largest id ever inserted
+    int idCapacity() const { return cellOf.size(); }
+
+    Point positionOf(int id) const { return position[id]; }
+
+    // All ids within distance r of q (unordered)
+    vector<int> radiusQuery(Point q, double r) const {
+        vector<int> result;
+        double r2 = r * r;
+        int c0 = colOf(q.x - r), c1 = colOf(q.x + r);
+        int r0 = rowOf(q.y - r), r1 = rowOf(q.y + r);
+        for (int y = r0; y <= r1; ++y)
+            for (int x = c0; x <= c1; ++x)
+                for (int id : cells[y * cols + x])
+                    if (squaredDistance(position[id], q) <= r2) result.push_back(id);
+        return result;
+    }
+
+    // The k ids closest to q, nearest first
+    vector<int> nearest(Point q, int k) const {
+        vector<pair<double, int>> best;  // Max-heap of (squared distance, id)
+        if (k <= 0) return {};
+        int cx = colOf(q.x), cy = rowOf(q.y);
+        int maxRing = max(cols, rows);
+        for (int ring = 0; ring <= maxRing; ++ring) {
+            if ((int)best.size() == k) {
+                double bound = ringLowerBound(q, cx, cy, ring);
+                if (bound * bound > best.front().first) break;  // Nothing closer further out
+            }
+            visitRing(cx, cy, ring, [&](int id) {
+                double d = squaredDistance(position[id], q);
+                if ((int)best.size() < k) {
+                    best.push_back({d, id});
+                    push_heap(best.begin(), best.end());
+                } else if (d < best.front().first) {
+                    pop_heap(best.begin(), best.end());
+                    best.back() = {d, id};
+                    push_heap(best.begin(), best.end());
+                }
+            });
         }
+        sort_heap(best.begin(), best.end());
+        vector<int> result;
+        for (auto& entry : best) result.push_back(entry.second);
+        return result;
     }
+};
 
-    // Add menu item to recommendation system
-    void addMenuItem(string item) {
-        menuItems.push_back(item);
+// ----------- Bulk-Loaded K-D Tree -----------
+/**
+ * Static 2D k-d tree for locations that rarely move (restaurants, drop points)
+ * Built once from all points with median splits (nth_element), stored as a
+ * single implicit array: the node of range [lo, hi) is its median element,
+ * children are [lo, mid) and [mid + 1, hi). No child pointers, so a query
+ * walks contiguous memory; small ranges are scanned linearly as leaves
+ * Build: O(n log n), kNN / radius query: O(log n + output) on average
+ */
+class KDTree {
+private:
+    struct Entry {
+        double x, y;
+        int id;
+        int splitDim;  // 0: split on x, 1: split on y (only meaningful for inner nodes)
+    };
+    vector<Entry> nodes;
+    static const int LEAF_SIZE = 8;  // Ranges this small are scanned, not split
+
+    void build(int lo, int hi) {
+        if (hi - lo <= LEAF_SIZE) return;
+        // Split along the dimension with the larger spread
+        double minX = nodes[lo].x, maxX = minX, minY = nodes[lo].y, maxY = minY;
+        for (int i = lo + 1; i < hi; ++i) {
+            minX = min(minX, nodes[i].x); maxX = max(maxX, nodes[i].x);
+            minY = min(minY, nodes[i].y); maxY = max(maxY, nodes[i].y);
+        }
+        int dim = (maxX - minX >= maxY - minY) ? 0 : 1;
+        int mid = lo + (hi - lo) / 2;
+        nth_element(nodes.begin() + lo, nodes.begin() + mid, nodes.begin() + hi,
+                    [dim](const Entry& a, const Entry& b) {
+                        return dim == 0 ? a.x < b.x : a.y < b.y;
+                    });
+        nodes[mid].splitDim = dim;
+        build(lo, mid);
+        build(mid + 1, hi);
     }
 
-    // Recommend menu items containing specified keyword
-    // Uses KMP algorithm for efficient string matching
-    void recommendMenus(string keyword) {
-        cout << "\nMenu Recommendations for: " << keyword << "\n";
-        for (const string& item : menuItems) {
-            // Use KMP algorithm to check if menu item contains keyword
-            if (MenuRecommender::containsKeyword(item, keyword))
-                cout << "- " << item << "\n";
+    // Offer a candidate to the bounded max-heap of the k best
+    static void offer(vector<pair<double, int>>& best, int k, double d, int id) {
+        if ((int)best.size() < k) {
+            best.push_back({d, id});
+            push_heap(best.begin(), best.end());
+        } else if (d < best.front().first) {
+            pop_heap(best.begin(), best.end());
+            best.back() = {d, id};
+            push_heap(best.begin(), best.end());
         }
     }
 
-    // Build minimum spanning tree using Kruskal's algorithm
-    // Returns minimum cost to connect all delivery locations
-    // Time Complexity: O(E log E) where E is number of edges
-    int buildMinimumCostNetwork() {
-        // Step 1: Sort all edges by weight in ascending order
-        sort(edges.begin(), edges.end());
-        
-        // Step 2: Initialize disjoint set for cycle detection
-        DisjointSet ds(numNodes);
+    void nearest(int lo, int hi, const Point& q, int k, vector<pair<double, int>>& best) const {
+        if (hi - lo <= LEAF_SIZE) {
+            for (int i = lo; i < hi; ++i)
+                offer(best, k, squaredDistance({nodes[i].x, nodes[i].y}, q), nodes[i].id);
+            return;
+        }
+        int mid = lo + (hi - lo) / 2;
+        const Entry& e = nodes[mid];
+        offer(best, k, squaredDistance({e.x, e.y}, q), e.id);
+        double diff = (e.splitDim == 0) ? q.x - e.x : q.y - e.y;
+        // Descend into the side containing q first, then the other side only
+        // if the splitting line is closer than the current k-th best
+        if (diff < 0) nearest(lo, mid, q, k, best);
+        else nearest(mid + 1, hi, q, k, best);
+        if ((int)best.size() < k || diff * diff < best.front().first) {
+            if (diff < 0) nearest(mid + 1, hi, q, k, best);
+            else nearest(lo, mid, q, k, best);
+        }
+    }
 
-        int totalCost = 0;
-        cout << "\nSelected Routes in Minimum Cost Network:\n";
-        
-        // Step 3: Process edges in sorted order (Kruskal's algorithm)
-        for (Edge e : edges) {
-            // Check if adding this edge creates a cycle
-            if (ds.find(e.u) != ds.find(e.v)) {
-                ds.unite(e.u, e.v);          // Add edge to MST
-                totalCost += e.weight;        // Add cost to total
-                cout << "Route: " << e.u << " <-> " << e.v << " | Cost: " << e.weight << "\n";
-            }
-            // If edge creates cycle, skip it (greedy choice)
+    void radius(int lo, int hi, const Point& q, double r2, vector<int>& out) const {
+        if (hi - lo <= LEAF_SIZE) {
+            for (int i = lo; i < hi; ++i)
+                if (squaredDistance({nodes[i].x, nodes[i].y}, q) <= r2) out.push_back(nodes[i].id);
+            return;
         }
-        return totalCost;
+        int mid = lo + (hi - lo) / 2;
+        const Entry& e = nodes[mid];
+        if (squaredDistance({e.x, e.y}, q) <= r2) out.push_back(e.id);
+        double diff = (e.splitDim == 0) ? q.x - e.x : q.y - e.y;
+        if (diff < 0 || diff * diff <= r2) radius(lo, mid, q, r2, out);
+        if (diff >= 0 || diff * diff <= r2) radius(mid + 1, hi, q, r2, out);
+    }
+
+public:
+    // Bulk-load from (id, point) pairs, replacing any previous contents
+    void build(const vector<pair<int, Point>>& points) {
+        nodes.clear();
+        nodes.reserve(points.size());
+        for (const auto& [id, p] : points) nodes.push_back({p.x, p.y, id, 0});
+        build(0, nodes.size());
+    }
+
+    int size() const { return nodes.size(); }
+
+    // The k ids closest to q, nearest first
+    vector<int> nearest(Point q, int k) const {
+        vector<pair<double, int>> best;
+        if (k <= 0 || nodes.empty()) return {};
+        best.reserve(k);
+        nearest(0, nodes.size(), q, k, best);
+        sort_heap(best.begin(), best.end());
+        vector<int> result;
+        for (auto& entry : best) result.push_back(entry.second);
+        return result;
+    }
+
+    // All ids within distance r of q (unordered)
+    vector<int> radiusQuery(Point q, double r) const {
+        vector<int> result;
+        radius(0, nodes.size(), q, r * r, result);
+        return result;
     }
 };
 
-// ----------- Main Driver -----------
+// ----------- Time-Dependent Route Cost Profiles -----------
 /**
- * Demonstration of the complete food delivery and logistics system
- * Shows integration of MST, Priority Queue, and String Matching algorithms
+ * Hour-of-day travel cost profiles for routes
+ * A profile is 24 slot costs (uint16_t, 48 bytes); identical profiles are
+ * stored once and shared by id, so a city where most roads follow a few
+ * traffic patterns needs only a handful of profiles
+ * Between slot midpoints the cost is interpolated linearly (cyclic over the
+ * day), which keeps arrival times monotone in departure time (FIFO) as long
+ * as a cost never drops by more than SLOT_MINUTES from one slot to the next
  */
-int main() {
-    // Initialize delivery network with 6 locations (nodes 0-5)
-    DeliveryNetwork dn(6);
+class TimeProfileStore {
+public:
+    static const int SLOTS = 24;           // One slot per hour
+    static const int SLOT_MINUTES = 60;
+    static const int DAY_MINUTES = SLOTS * SLOT_MINUTES;
 
-    // Add delivery routes between locations
-    // Format: addRoute(source, destination, cost, hasPromo)
-    dn.addRoute(0, 1, 4);
-    dn.addRoute(0, 2, 4);
-    dn.addRoute(1, 2, 2, true);  // Promotional route with discount
-    dn.addRoute(1, 3, 5);
-    dn.addRoute(2, 3, 8);
-    dn.addRoute(2, 4, 10);
-    dn.addRoute(3, 4, 2);
-    dn.addRoute(3, 5, 6, true); // Promotional route with discount
-    dn.addRoute(4, 5, 3);
+private:
+    vector<uint16_t> costs;                          // Profile p is costs[p * SLOTS .. p * SLOTS + SLOTS)
+    unordered_map<uint64_t, vector<int>> byHash;     // Content hash -> profile ids (deduplication)
 
-    // Add orders with different priorities for demonstration
-    // Format: addOrder(orderID, priority)
-    dn.addOrder(101, 2);  // Low priority
-    dn.addOrder(102, 5);  // High priority (processed first)
-    dn.addOrder(103, 3);  // Medium priority
+public:
+    // Store a profile (slot costs are clamped to [0, 65535]) and return its id
+    // An identical existing profile is reused; an empty profile is rejected
+    int intern(const vector<int>& slotCosts) {
+        if (slotCosts.empty()) throw runtime_error("time profile needs at least one slot cost");
+        array<uint16_t, SLOTS> packed{};
+        uint64_t hash = 1469598103934665603ULL;  // FNV-1a over the packed costs
+        for (int s = 0; s < SLOTS; ++s) {
+            int c = slotCosts[s % slotCosts.size()];
+            packed[s] = (uint16_t)min(max(c, 0), 65535);
+            hash = (hash ^ packed[s]) * 1099511628211ULL;
+        }
+        for (int id : byHash[hash])
+            if (equal(packed.begin(), packed.end(), costs.begin() + (size_t)id * SLOTS)) return id;
+        int id = count();
+        costs.insert(costs.end(), packed.begin(), packed.end());
+        byHash[hash].push_back(id);
+        return id;
+    }
 
-    // Add menu items for recommendation system
-    dn.addMenuItem("Spicy Chicken Rice");
-    dn.addMenuItem("Sweet and Sour Pork");
-    dn.addMenuItem("Vegetarian Salad");
-    dn.addMenuItem("Grilled Chicken Wrap");
+    int count() const { return costs.size() / SLOTS; }
 
-    // Execute system operations
-    dn.processOrders();           // Process orders by priority using max heap
-    dn.recommendMenus("Chicken"); // Find menu items containing "Chicken" using KMP
-    
-    // Build minimum cost network using Kruskal's MST algorithm
-    int minCost = dn.buildMinimumCostNetwork();
-    cout << "\nTotal Minimum Cost to Build Network: " << minCost << "\n";
+    // Cost of the profile during a whole slot
+    int cost(int profile, int slot) const {
+        return costs[(size_t)profile * SLOTS + slot];
+    }
+
+    // Cost when departing at `minute` of the day (piecewise-linear between slot midpoints)
+    double costAt(int profile, double minute) const {
+        double m = fmod(minute, (double)DAY_MINUTES);
+        if (m < 0) m += DAY_MINUTES;
+        double pos = m / SLOT_MINUTES - 0.5;        // Slot midpoints sit at integer positions
+        int slot = (int)floor(pos);
+        double frac = pos - slot;
+        int a = (slot + SLOTS) % SLOTS, b = (slot + 1) % SLOTS;
+        return cost(profile, a) * (1 - frac) + cost(profile, b) * frac;
+    }
+};
+
+// ----------- Neighbor-Cursor Graph Algorithms -----------
+/**
+ * Routing and MST algorithms written once against a minimal graph interface
+ *   int numNodes() const;
+ *   Cursor neighbors(int u) const;  // valid(), next(), target(), weight()
+ * Implemented by the plain CSR RouteGraph and by CompressedRouteGraph, so the
+ * same code runs on uncompressed and varint-packed adjacency
+ */
+
+// Dijkstra's algorithm from source; unreachable nodes keep numeric_limits<long long>::max()
+// Time Complexity: O(E log V)
+template <class Graph>
+void dijkstraShortestPaths(const Graph& graph, int source, vector<long long>& dist) {
+    dist.assign(graph.numNodes(), numeric_limits<long long>::max());
+    vector<pair<long long, int>> heap;  // Min-heap of (distance, node) via greater<>
+    dist[source] = 0;
+    heap.push_back({0, source});
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), greater<>());
+        auto [d, u] = heap.back();
+        heap.pop_back();
+        if (d > dist[u]) continue;  // Stale entry (lazy deletion)
+        for (auto arc = graph.neighbors(u); arc.valid(); arc.next()) {
+            long long nd = d + arc.weight();
+            if (nd < dist[arc.target()]) {
+                dist[arc.target()] = nd;
+                heap.push_back({nd, arc.target()});
+                push_heap(heap.begin(), heap.end(), greater<>());
+            }
+        }
+    }
+}
+
+// Prim's algorithm: total cost of a minimum spanning forest
+// Optionally reports the chosen routes. Time Complexity: O(E log V)
+template <class Graph>
+long long primMinimumSpanningCost(const Graph& graph, vector<Edge>* selected = nullptr) {
+    int n = graph.numNodes();
+    vector<bool> inTree(n, false);
+    vector<tuple<long long, int, int>> heap;  // (cost, node, reached from)
+    long long total = 0;
+    for (int root = 0; root < n; ++root) {
+        if (inTree[root]) continue;  // One tree per connected component
+        heap.push_back({0, root, -1});
+        while (!heap.empty()) {
+            pop_heap(heap.begin(), heap.end(), greater<>());
+            auto [cost, u, from] = heap.back();
+            heap.pop_back();
+            if (inTree[u]) continue;
+            inTree[u] = true;
+            if (from >= 0) {
+                total += cost;
+                if (selected) selected->push_back(Edge(from, u, (int)cost));
+            }
+            for (auto arc = graph.neighbors(u); arc.valid(); arc.next()) {
+                if (inTree[arc.target()]) continue;
+                heap.push_back({arc.weight(), arc.target(), u});
+                push_heap(heap.begin(), heap.end(), greater<>());
+            }
+        }
+    }
+    return total;
+}
+
+// ----------- Route Graph (CSR Adjacency) -----------
+/**
+ * Compressed sparse row adjacency built from the undirected route list
+ * Neighbours of node u are target[offset[u] .. offset[u + 1]) with matching weights
+ * Used for shortest-path travel costs between delivery locations
+ */
+class RouteGraph {
+private:
+    int nodeCount = 0;
+    vector<int> offset;  // offset[u]: first arc of u, offset[nodeCount]: total arcs
+    vector<int> target;  // Arc heads
+    vector<int> weight;  // Arc costs
+    vector<int> profile; // Arc time-of-day profile ids (-1 = constant weight)
+
+public:
+    // Build from undirected edges: each route becomes two arcs
+    // Time Complexity: O(V + E)
+    void build(int numNodes, const vector<Edge>& edges) {
+        nodeCount = numNodes;
+        offset.assign(numNodes + 1, 0);
+        for (const Edge& e : edges) { offset[e.u + 1]++; offset[e.v + 1]++; }
+        for (int u = 0; u < numNodes; ++u) offset[u + 1] += offset[u];
+        target.resize(offset[numNodes]);
+        weight.resize(offset[numNodes]);
+        profile.resize(offset[numNodes]);
+        vector<int> fill(offset.begin(), offset.end() - 1);
+        for (const Edge& e : edges) {
+            target[fill[e.u]] = e.v; weight[fill[e.u]] = e.weight; profile[fill[e.u]++] = e.profile;
+            target[fill[e.v]] = e.u; weight[fill[e.v]] = e.weight; profile[fill[e.v]++] = e.profile;
+        }
+    }
+
+    int numNodes() const { return nodeCount; }
+
+    static constexpr long long UNREACHABLE = numeric_limits<long long>::max();
+
+    // Arcs of one node, in the neighbor-cursor interface shared with CompressedRouteGraph
+    class Cursor {
+    private:
+        const int* targets;
+        const int* weights;
+        int pos, end;
+    public:
+        Cursor(const int* targets, const int* weights, int begin, int end)
+            : targets(targets), weights(weights), pos(begin), end(end) {}
+        bool valid() const { return pos < end; }
+        void next() { ++pos; }
+        int target() const { return targets[pos]; }
+        int weight() const { return weights[pos]; }
+    };
+
+    Cursor neighbors(int u) const {
+        return Cursor(target.data(), weight.data(), offset[u], offset[u + 1]);
+    }
+
+    // Bytes used by offsets, targets, weights and profile ids
+    size_t memoryBytes() const {
+        return sizeof(int) * (offset.size() + target.size() + weight.size() + profile.size());
+    }
+
+    // Dijkstra's algorithm from source; unreachable nodes keep UNREACHABLE
+    // Time Complexity: O(E log V)
+    void shortestPaths(int source, vector<long long>& dist) const {
+        dijkstraShortestPaths(*this, source, dist);
+    }
+
+    // Time-dependent Dijkstra: earliest arrival minute at every node when
+    // leaving source at `departure`; an arc's cost is evaluated at the time
+    // the courier enters it. Exact when every profile is FIFO
+    // Unreachable nodes get +infinity. Time Complexity: O(E log V)
+    void earliestArrivals(int source, double departure, const TimeProfileStore& profiles,
+                          vector<double>& arrival) const {
+        arrival.assign(nodeCount, numeric_limits<double>::infinity());
+        vector<pair<double, int>> heap;
+        arrival[source] = departure;
+        heap.push_back({departure, source});
+        while (!heap.empty()) {
+            pop_heap(heap.begin(), heap.end(), greater<>());
+            auto [t, u] = heap.back();
+            heap.pop_back();
+            if (t > arrival[u]) continue;
+            for (int a = offset[u]; a < offset[u + 1]; ++a) {
+                double cost = profile[a] < 0 ? weight[a] : profiles.costAt(profile[a], t);
+                if (t + cost < arrival[target[a]]) {
+                    arrival[target[a]] = t + cost;
+                    heap.push_back({t + cost, target[a]});
+                    push_heap(heap.begin(), heap.end(), greater<>());
+                }
+            }
+        }
+    }
+};
+
+// ----------- Compressed Route Graph (Delta + Varint CSR) -----------
+/**
+ * Read-only, compressed adjacency for national-scale delivery networks
+ * - Nodes are renumbered (BFS / reverse Cuthill-McKee) so neighbours get
+ *   nearby ids: neighbour gaps shrink and traversals touch nearby memory
+ * - Each node's record is varint(degree) followed by (gap, weight) varint
+ *   pairs, neighbours sorted; the first gap is zig-zag encoded relative to
+ *   the node itself, the rest are differences to the previous neighbour
+ * - Cursors decode blocks of arcs with an SSE2 fast path that expands 16
+ *   single-byte varints at once
+ * - save() writes a flat file (header, offsets, permutations, bytes) that
+ *   openMapped() maps read-only without any parsing
+ * Algorithms see internal (renumbered) ids; use internalId / externalId
+ */
+enum class NodeOrder { ORIGINAL, BFS, RCM };
+
+class CompressedRouteGraph {
+private:
+    struct FileHeader {
+        char magic[8];        // "DNCSR01"
+        uint32_t version;
+        uint32_t nodeCount;
+        uint64_t arcCount;
+        uint64_t dataBytes;
+    };
+    static const size_t PADDING = 16;  // SIMD loads may read up to 15 bytes past the last record
+
+    uint32_t nodeCount = 0;
+    uint64_t arcCount = 0;
+    uint64_t dataBytes = 0;
+    const uint64_t* offsets = nullptr;  // offsets[x]: first byte of node x's record
+    const int32_t* newToOld = nullptr;  // internal id -> original node
+    const int32_t* oldToNew = nullptr;  // original node -> internal id
+    const uint8_t* data = nullptr;      // Encoded records (+ PADDING zero bytes)
+
+    // Backing storage: either owned vectors (after build) or a file mapping
+    vector<uint64_t> ownedOffsets;
+    vector<int32_t> ownedNewToOld, ownedOldToNew;
+    vector<uint8_t> ownedData;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    static void appendVarint(vector<uint8_t>& out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+    static int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+    // Node permutation: BFS visiting lower-degree neighbours first, started
+    // from a minimum-degree node of every component (Cuthill-McKee); RCM reverses it
+    static vector<int32_t> computeOrder(const RouteGraph& graph, NodeOrder order) {
+        int n = graph.numNodes();
+        vector<int32_t> sequence(n);
+        if (order == NodeOrder::ORIGINAL) {
+            for (int i = 0; i < n; ++i) sequence[i] = i;
+            return sequence;
+        }
+        vector<int> degree(n, 0);
+        for (int u = 0; u < n; ++u)
+            for (auto arc = graph.neighbors(u); arc.valid(); arc.next()) degree[u]++;
+        vector<int> byDegree(n);
+        for (int i = 0; i < n; ++i) byDegree[i] = i;
+        stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) { return degree[a] < degree[b]; });
+        vector<bool> seen(n, false);
+        vector<int> children;
+        size_t head = 0, tail = 0;
+        for (int start : byDegree) {
+            if (seen[start]) continue;
+            seen[start] = true;
+            sequence[tail++] = start;
+            while (head < tail) {
+                int u = sequence[head++];
+                children.clear();
+                for (auto arc = graph.neighbors(u); arc.valid(); arc.next())
+                    if (!seen[arc.target()]) { seen[arc.target()] = true; children.push_back(arc.target()); }
+                sort(children.begin(), children.end(), [&](int a, int b) { return degree[a] < degree[b]; });
+                for (int c : children) sequence[tail++] = c;
+            }
+        }
+        if (order == NodeOrder::RCM) reverse(sequence.begin(), sequence.end());
+        return sequence;
+    }
+
+    void release() {
+        if (mapping) munmap(mapping, mappingSize);
+        mapping = nullptr;
+    }
+
+public:
+    // Decode `count` LEB128 varints starting at p; returns the byte after the last one
+    static const uint8_t* decodeVarints(const uint8_t* p, uint32_t* out, int count) {
+#ifdef __SSE2__
+        while (count >= 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            unsigned continued = _mm_movemask_epi8(bytes);  // Bit i set: byte i continues a varint
+            if (continued == 0) {
+                // 16 single-byte values: widen 8 -> 16 -> 32 bits
+                __m128i zero = _mm_setzero_si128();
+                __m128i lo = _mm_unpacklo_epi8(bytes, zero), hi = _mm_unpackhi_epi8(bytes, zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi16(hi, zero));
+                p += 16; out += 16; count -= 16;
+                continue;
+            }
+            // Copy the single-byte run before the first multi-byte varint, then decode that one
+            int run = __builtin_ctz(continued);
+            for (int i = 0; i < run; ++i) *out++ = p[i];
+            p += run; count -= run;
+            uint32_t value = 0;
+            int shift = 0;
+            while (*p & 0x80) { value |= (uint32_t)(*p++ & 0x7F) << shift; shift += 7; }
+            *out++ = value | (uint32_t)*p++ << shift;
+            count--;
+        }
+#endif
+        while (count-- > 0) {
+            uint32_t value = 0;
+            int shift = 0;
+            while (*p & 0x80) { value |= (uint32_t)(*p++ & 0x7F) << shift; shift += 7; }
+            *out++ = value | (uint32_t)*p++ << shift;
+        }
+        return p;
+    }
+
+    // Forward iterator over one node's arcs, decoding BLOCK arcs at a time
+    class Cursor {
+    private:
+        static constexpr int BLOCK = 32;
+        const uint8_t* p;        // Next undecoded byte
+        int remaining;           // Arcs not yet decoded
+        int pos = 0, count = 0;  // Position within the decoded block
+        int32_t previous;        // Last decoded neighbour (delta base)
+        bool first = true;       // First gap is relative to the node itself
+        int32_t targets[BLOCK];
+        uint32_t weights[BLOCK];
+
+        void refill() {
+            uint32_t raw[2 * BLOCK];
+            count = min(remaining, BLOCK);
+            p = decodeVarints(p, raw, 2 * count);
+            for (int i = 0; i < count; ++i) {
+                previous = first ? previous + unzigzag(raw[2 * i]) : previous + (int32_t)raw[2 * i];
+                first = false;
+                targets[i] = previous;
+                weights[i] = raw[2 * i + 1];
+            }
+            remaining -= count;
+            pos = 0;
+        }
+
+    public:
+        Cursor(const uint8_t* record, int node) : previous(node) {
+            uint32_t degree;
+            p = decodeVarints(record, &degree, 1);
+            remaining = degree;
+            if (remaining > 0) refill();
+        }
+        bool valid() const { return pos < count; }
+        void next() {
+            if (++pos == count && remaining > 0) refill();
+        }
+        int target() const { return targets[pos]; }
+        int weight() const { return weights[pos]; }
+    };
+
+    CompressedRouteGraph() = default;
+    CompressedRouteGraph(const CompressedRouteGraph&) = delete;
+    CompressedRouteGraph& operator=(const CompressedRouteGraph&) = delete;
+    CompressedRouteGraph(CompressedRouteGraph&& other) noexcept { *this = move(other); }
+    CompressedRouteGraph& operator=(CompressedRouteGraph&& other) noexcept {
+        if (this == &other) return *this;
+        release();
+        nodeCount = other.nodeCount; arcCount = other.arcCount; dataBytes = other.dataBytes;
+        offsets = other.offsets; newToOld = other.newToOld; oldToNew = other.oldToNew; data = other.data;
+        ownedOffsets = move(other.ownedOffsets);   // Moving a vector keeps its buffer, so the views stay valid
+        ownedNewToOld = move(other.ownedNewToOld);
+        ownedOldToNew = move(other.ownedOldToNew);
+        ownedData = move(other.ownedData);
+        mapping = other.mapping; mappingSize = other.mappingSize;
+        other.mapping = nullptr;
+        other.nodeCount = 0;
+        return *this;
+    }
+    ~CompressedRouteGraph() { release(); }
+
+    // Compress an uncompressed route graph, renumbering nodes by `order`
+    // Time Complexity: O(V + E log d) with d the maximum degree
+    void build(const RouteGraph& graph, NodeOrder order = NodeOrder::RCM) {
+        release();
+        nodeCount = graph.numNodes();
+        ownedNewToOld = computeOrder(graph, order);
+        ownedOldToNew.assign(nodeCount, 0);
+        for (uint32_t x = 0; x < nodeCount; ++x) ownedOldToNew[ownedNewToOld[x]] = x;
+        ownedOffsets.assign(nodeCount + 1, 0);
+        ownedData.clear();
+        arcCount = 0;
+        vector<pair<int32_t, uint32_t>> arcs;
+        for (uint32_t x = 0; x < nodeCount; ++x) {
+            ownedOffsets[x] = ownedData.size();
+            arcs.clear();
+            for (auto arc = graph.neighbors(ownedNewToOld[x]); arc.valid(); arc.next())
+                arcs.push_back({ownedOldToNew[arc.target()], (uint32_t)arc.weight()});
+            sort(arcs.begin(), arcs.end());
+            appendVarint(ownedData, arcs.size());
+            int32_t previous = x;
+            for (size_t i = 0; i < arcs.size(); ++i) {
+                uint32_t gap = i == 0 ? zigzag(arcs[i].first - previous) : (uint32_t)(arcs[i].first - previous);
+                appendVarint(ownedData, gap);
+                appendVarint(ownedData, arcs[i].second);
+                previous = arcs[i].first;
+            }
+            arcCount += arcs.size();
+        }
+        ownedOffsets[nodeCount] = ownedData.size();
+        dataBytes = ownedData.size();
+        ownedData.resize(dataBytes + PADDING, 0);
+        offsets = ownedOffsets.data();
+        newToOld = ownedNewToOld.data();
+        oldToNew = ownedOldToNew.data();
+        data = ownedData.data();
+    }
+
+    // Write the mmap-able file layout: header | offsets | newToOld | oldToNew | data
+    void save(const string& path) const {
+        FILE* out = fopen(path.c_str(), "wb");
+        if (!out) throw runtime_error("cannot write " + path);
+        FileHeader header = {{'D', 'N', 'C', 'S', 'R', '0', '1', 0}, 1, nodeCount, arcCount, dataBytes};
+        bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                       fwrite(offsets, sizeof(uint64_t), nodeCount + 1, out) == nodeCount + 1 &&
+                       fwrite(newToOld, sizeof(int32_t), nodeCount, out) == nodeCount &&
+                       fwrite(oldToNew, sizeof(int32_t), nodeCount, out) == nodeCount &&
+                       fwrite(data, 1, dataBytes + PADDING, out) == dataBytes + PADDING;
+        if (fclose(out) != 0 || !written) throw runtime_error("cannot write " + path);
+    }
+
+    // Map a saved graph read-only; pages are loaded on demand by the OS
+    static CompressedRouteGraph openMapped(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open " + path);
+        off_t size = lseek(fd, 0, SEEK_END);
+        void* base = size >= (off_t)sizeof(FileHeader) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (base == MAP_FAILED) throw runtime_error("cannot map " + path);
+
+        CompressedRouteGraph graph;
+        graph.mapping = base;
+        graph.mappingSize = size;
+        const FileHeader* header = static_cast<const FileHeader*>(base);
+        if (memcmp(header->magic, "DNCSR01", 8) != 0 || header->version != 1)
+            throw runtime_error(path + " is not a compressed route graph");
+        graph.nodeCount = header->nodeCount;
+        graph.arcCount = header->arcCount;
+        graph.dataBytes = header->dataBytes;
+        const char* cursor = static_cast<const char*>(base) + sizeof(FileHeader);
+        graph.offsets = reinterpret_cast<const uint64_t*>(cursor);
+        cursor += sizeof(uint64_t) * (graph.nodeCount + 1);
+        graph.newToOld = reinterpret_cast<const int32_t*>(cursor);
+        cursor += sizeof(int32_t) * graph.nodeCount;
+        graph.oldToNew = reinterpret_cast<const int32_t*>(cursor);
+        cursor += sizeof(int32_t) * graph.nodeCount;
+        graph.data = reinterpret_cast<const uint8_t*>(cursor);
+        if (cursor + graph.dataBytes + PADDING > static_cast<const char*>(base) + size)
+            throw runtime_error(path + " is truncated");
+        return graph;
+    }
+
+    int numNodes() const { return nodeCount; }
+    uint64_t numArcs() const { return arcCount; }
+
+    Cursor neighbors(int x) const { return Cursor(data + offsets[x], x); }
+
+    int internalId(int node) const { return oldToNew[node]; }
+    int externalId(int x) const { return newToOld[x]; }
+
+    // Bytes used by offsets, permutations and encoded arcs
+    size_t memoryBytes() const {
+        return sizeof(uint64_t) * (nodeCount + 1) + 2 * sizeof(int32_t) * nodeCount + dataBytes;
+    }
+};
+
+// ----------- Dispatch Optimizer (Vehicle Routing Heuristics) -----------
+/**
+ * Capacitated vehicle routing over a precomputed travel-cost matrix
+ * Every route starts and ends at the depot (stop 0)
+ * 1. Construction: Clarke-Wright savings, restricted to each stop's nearest
+ *    neighbours so the savings list stays O(n * K) instead of O(n^2)
+ * 2. Improvement: 2-opt and Or-opt inside each route, routes spread over
+ *    worker threads, alternating with inter-route relocate (move a stop to
+ *    another route) and exchange (swap stops of two routes) moves that keep
+ *    every route within capacity, until no move improves or the deadline passes
+ *    Inter-route candidates are restricted to each stop's nearest neighbours
+ */
+class DispatchOptimizer {
+private:
+    const vector<int>& matrix;  // Row-major travel costs between matrix points
+    int points;                 // Matrix dimension
+    vector<int> pointOf;        // pointOf[stop]: matrix row of each stop (0 = depot)
+    static constexpr int NEIGHBOURS = 24;  // Savings candidates per stop
+
+    // Reverse route[i..j] in place if it shortens the tour (one 2-opt pass)
+    bool twoOptPass(vector<int>& route) const {
+        bool improved = false;
+        int n = route.size();
+        for (int i = 0; i < n - 1; ++i) {
+            int a = i == 0 ? 0 : route[i - 1];
+            for (int j = i + 1; j < n; ++j) {
+                int b = route[i], c = route[j];
+                int d = j == n - 1 ? 0 : route[j + 1];
+                long long delta = (long long)cost(a, c) + cost(b, d) - cost(a, b) - cost(c, d);
+                if (delta < 0) {
+                    reverse(route.begin() + i, route.begin() + j + 1);
+                    improved = true;
+                }
+            }
+        }
+        return improved;
+    }
+
+    // Move a segment of 1-3 consecutive stops to a cheaper position (one Or-opt pass)
+    bool orOptPass(vector<int>& route) const {
+        int n = route.size();
+        for (int len = 1; len <= 3 && len < n; ++len) {
+            for (int i = 0; i + len <= n; ++i) {
+                int prev = i == 0 ? 0 : route[i - 1];
+                int next = i + len == n ? 0 : route[i + len];
+                int first = route[i], last = route[i + len - 1];
+                long long removeGain = (long long)cost(prev, first) + cost(last, next) - cost(prev, next);
+                // Try inserting the segment between route[j - 1] and route[j] outside [i, i + len]
+                for (int j = 0; j <= n; ++j) {
+                    if (j >= i && j <= i + len) continue;
+                    int a = j == 0 ? 0 : route[j - 1];
+                    int b = j == n ? 0 : route[j];
+                    long long insertCost = (long long)cost(a, first) + cost(last, b) - cost(a, b);
+                    if (insertCost < removeGain) {
+                        vector<int> segment(route.begin() + i, route.begin() + i + len);
+                        route.erase(route.begin() + i, route.begin() + i + len);
+                        int at = j > i ? j - len : j;
+                        route.insert(route.begin() + at, segment.begin(), segment.end());
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // The NEIGHBOURS cheapest stops to reach from each stop (depot excluded)
+    vector<vector<int>> nearestStops() const {
+        int n = numStops();
+        vector<vector<int>> nearest(n);
+        vector<pair<int, int>> candidates;
+        for (int i = 1; i < n; ++i) {
+            candidates.clear();
+            for (int j = 1; j < n; ++j)
+                if (j != i) candidates.push_back({cost(i, j), j});
+            int k = min((int)candidates.size(), NEIGHBOURS);
+            nth_element(candidates.begin(), candidates.begin() + k, candidates.end());
+            sort(candidates.begin(), candidates.begin() + k);
+            for (int c = 0; c < k; ++c) nearest[i].push_back(candidates[c].second);
+        }
+        return nearest;
+    }
+
+    // Routing state shared by the inter-route moves
+    struct RouteState {
+        vector<vector<int>>& routes;
+        vector<int> load;     // load[route]: total demand
+        vector<int> routeOf;  // routeOf[stop]
+        vector<int> posOf;    // posOf[stop]: index in its route
+
+        // Stop at position i of route r, the depot (0) past either end
+        int at(int r, int i) const {
+            return i < 0 || i >= (int)routes[r].size() ? 0 : routes[r][i];
+        }
+
+        void reindex(int r) {
+            for (size_t i = 0; i < routes[r].size(); ++i) {
+                routeOf[routes[r][i]] = r;
+                posOf[routes[r][i]] = i;
+            }
+        }
+    };
+
+    // One sweep of inter-route relocate and exchange moves; every improving
+    // move that keeps both routes within capacity is applied as it is found
+    bool interRoutePass(RouteState& st, const vector<int>& demand, int capacity,
+                        const vector<vector<int>>& nearest, chrono::steady_clock::time_point deadline) const {
+        bool improved = false;
+        int n = numStops();
+        for (int s = 1; s < n; ++s) {
+            if ((s & 63) == 0 && chrono::steady_clock::now() >= deadline) break;
+            for (int t : nearest[s]) {
+                int A = st.routeOf[s], B = st.routeOf[t];
+                if (A == B) continue;
+                int i = st.posOf[s], j = st.posOf[t];
+                int prevS = st.at(A, i - 1), nextS = st.at(A, i + 1);
+                long long removeGain = (long long)cost(prevS, s) + cost(s, nextS) - cost(prevS, nextS);
+
+                // Relocate: s goes just before or just after t
+                if (st.load[B] + demand[s] <= capacity) {
+                    int bestAt = -1;
+                    long long bestDelta = 0;
+                    for (int at : {j, j + 1}) {
+                        int a = st.at(B, at - 1), b = st.at(B, at);
+                        long long delta = (long long)cost(a, s) + cost(s, b) - cost(a, b) - removeGain;
+                        if (delta < bestDelta) { bestDelta = delta; bestAt = at; }
+                    }
+                    if (bestAt >= 0) {
+                        st.routes[A].erase(st.routes[A].begin() + i);
+                        st.routes[B].insert(st.routes[B].begin() + bestAt, s);
+                        st.load[A] -= demand[s];
+                        st.load[B] += demand[s];
+                        st.reindex(A);
+                        st.reindex(B);
+                        improved = true;
+                        continue;
+                    }
+                }
+
+                // Exchange: s takes the place of t's predecessor, t or t's successor, which moves to s's place
+                for (int k = j - 1; k <= j + 1; ++k) {
+                    int u = st.at(B, k);
+                    if (u == 0) continue;
+                    if (st.load[A] - demand[s] + demand[u] > capacity || st.load[B] - demand[u] + demand[s] > capacity) continue;
+                    int prevU = st.at(B, k - 1), nextU = st.at(B, k + 1);
+                    long long delta = (long long)cost(prevS, u) + cost(u, nextS) - cost(prevS, s) - cost(s, nextS) +
+                                      cost(prevU, s) + cost(s, nextU) - cost(prevU, u) - cost(u, nextU);
+                    if (delta < 0) {
+                        swap(st.routes[A][i], st.routes[B][k]);
+                        st.load[A] += demand[u] - demand[s];
+                        st.load[B] += demand[s] - demand[u];
+                        st.reindex(A);
+                        st.reindex(B);
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return improved;
+    }
+
+public:
+    // matrix: size x size costs; pointOf maps each stop to its matrix row
+    DispatchOptimizer(const vector<int>& matrix, int size, vector<int> pointOf)
+        : matrix(matrix), points(size), pointOf(move(pointOf)) {}
+
+    int numStops() const { return pointOf.size(); }
+
+    // Travel cost between two stops
+    int cost(int a, int b) const {
+        return matrix[(size_t)pointOf[a] * points + pointOf[b]];
+    }
+
+    // Cost of depot -> route... -> depot
+    long long routeCost(const vector<int>& route) const {
+        if (route.empty()) return 0;
+        long long total = cost(0, route.front()) + cost(route.back(), 0);
+        for (size_t i = 1; i < route.size(); ++i) total += cost(route[i - 1], route[i]);
+        return total;
+    }
+
+    // Clarke-Wright savings: start with one route per stop, then merge route
+    // ends in decreasing order of saving d(0,i) + d(0,j) - d(i,j) while the
+    // merged load stays within capacity
+    // Time Complexity: O(n^2) neighbour selection + O(nK log nK) sort + O(n log n) merges
+    vector<vector<int>> construct(const vector<int>& demand, int capacity) const {
+        int n = numStops();
+        vector<tuple<long long, int, int>> savings;
+        savings.reserve((size_t)n * NEIGHBOURS);
+        vector<pair<int, int>> candidates;
+        for (int i = 1; i < n; ++i) {
+            candidates.clear();
+            for (int j = 1; j < n; ++j)
+                if (j != i) candidates.push_back({cost(i, j), j});
+            int k = min((int)candidates.size(), NEIGHBOURS);
+            nth_element(candidates.begin(), candidates.begin() + k, candidates.end());
+            for (int c = 0; c < k; ++c) {
+                int j = candidates[c].second;
+                savings.push_back({(long long)cost(0, i) + cost(0, j) - cost(i, j), i, j});
+            }
+        }
+        sort(savings.begin(), savings.end(), greater<>());
+
+        vector<vector<int>> routes(n);
+        vector<int> routeOf(n), load(n);
+        for (int i = 1; i < n; ++i) {
+            routes[i] = {i};
+            routeOf[i] = i;
+            load[i] = demand[i];
+        }
+        for (const auto& [saving, i, j] : savings) {
+            if (saving <= 0) break;
+            int ri = routeOf[i], rj = routeOf[j];
+            if (ri == rj || load[ri] + load[rj] > capacity) continue;
+            vector<int>& A = routes[ri];
+            vector<int>& B = routes[rj];
+            // Both stops must be route ends; orient so that A ends in i and B starts with j
+            if (A.back() != i && A.front() != i) continue;
+            if (B.front() != j && B.back() != j) continue;
+            if (A.back() != i) reverse(A.begin(), A.end());
+            if (B.front() != j) reverse(B.begin(), B.end());
+            // Append the shorter route onto the longer one (small-to-large relabelling)
+            int keep = ri, drop = rj;
+            if (A.size() < B.size()) {
+                B.insert(B.begin(), A.begin(), A.end());
+                swap(keep, drop);
+            } else {
+                A.insert(A.end(), B.begin(), B.end());
+            }
+            for (int stop : routes[drop]) routeOf[stop] = keep;
+            load[keep] += load[drop];
+            routes[drop].clear();
+        }
+
+        vector<vector<int>> result;
+        for (int r = 1; r < n; ++r)
+            if (!routes[r].empty()) result.push_back(move(routes[r]));
+        return result;
+    }
+
+    // Local search until no move helps or the deadline passes: intra-route
+    // moves on every route in parallel, then a sequential sweep of
+    // inter-route moves, repeated while the sweep improves something
+    // Routes emptied by relocations are removed
+    void improve(vector<vector<int>>& routes, const vector<int>& demand, int capacity,
+                 chrono::steady_clock::time_point deadline, int threads) const {
+        threads = max(1, min(threads, (int)routes.size()));
+        auto intraRoute = [&]() {
+            atomic<size_t> nextRoute{0};
+            auto worker = [&]() {
+                for (size_t r = nextRoute++; r < routes.size(); r = nextRoute++) {
+                    bool improved = true;
+                    while (improved && chrono::steady_clock::now() < deadline)
+                        improved = twoOptPass(routes[r]) | orOptPass(routes[r]);
+                }
+            };
+            vector<thread> pool;
+            for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+            worker();
+            for (thread& t : pool) t.join();
+        };
+
+        vector<vector<int>> nearest = nearestStops();
+        RouteState st{routes, vector<int>(routes.size(), 0), vector<int>(numStops(), -1), vector<int>(numStops(), 0)};
+        for (size_t r = 0; r < routes.size(); ++r) {
+            for (int stop : routes[r]) st.load[r] += demand[stop];
+            st.reindex(r);
+        }
+        do {
+            intraRoute();
+        } while (chrono::steady_clock::now() < deadline && interRoutePass(st, demand, capacity, nearest, deadline));
+        routes.erase(remove_if(routes.begin(), routes.end(), [](const vector<int>& r) { return r.empty(); }), routes.end());
+    }
+};
+
+/**
+ * One courier's batch of orders: visit `stops` in order from the depot and back
+ */
+struct CourierRoute {
+    int courier = -1;          // Assigned courier (-1 if none was available)
+    vector<int> stops;         // Delivery nodes in visiting order
+    vector<int> orderIds;      // Orders carried, grouped by stop
+    long long cost = 0;        // Depot -> stops -> depot travel cost
+    int urgency = 0;           // Highest priority among the carried orders
+};
+
+struct DispatchPlan {
+    vector<CourierRoute> routes;  // Most urgent route first
+    long long totalCost = 0;      // Sum of route costs
+    long long initialCost = 0;    // Cost after construction, before local search
+    vector<Order> unassigned;     // Orders left pending (no location or unreachable)
+};
+
+// ----------- Idle Backoff for Polling Threads -----------
+/**
+ * Waiting policy for a polling loop that found no work: a few yields
+ * first, then sleeps that double up to `cap`, so idle dispatchers stop
+ * burning a core but still pick up new work within `cap`
+ */
+class IdleBackoff {
+private:
+    static const int YIELDS = 16;
+    chrono::microseconds cap;
+    int idleRounds = 0;
+
+public:
+    explicit IdleBackoff(chrono::microseconds cap = chrono::microseconds(1000)) : cap(cap) {}
+
+    // Call after a round that found work
+    void reset() { idleRounds = 0; }
+
+    // Call after a round that found nothing
+    void wait() {
+        if (idleRounds < YIELDS) {
+            this_thread::yield();
+        } else {
+            long long micros = 1LL << min(idleRounds - YIELDS, 20);
+            this_thread::sleep_for(chrono::microseconds(min<long long>(micros, cap.count())));
+        }
+        idleRounds++;
+    }
+};
+
+// ----------- Zone-Sharded Order Heaps with Work Stealing -----------
+/**
+ * Splits the city's pending orders into one max heap per delivery zone
+ * - Each zone is owned by one dispatcher thread that normally only touches
+ *   its own shard, so dispatchers do not contend on a single heap
+ * - An idle dispatcher steals the most urgent orders from the neighbouring
+ *   zone with the highest published priority (any zone if no neighbour has work)
+ * - Every shard publishes its current top priority in an atomic, so the
+ *   global "most urgent order across zones" query reads one atomic per
+ *   zone and never locks a shard
+ */
+class ZoneDispatcher {
+private:
+    static constexpr long long EMPTY = numeric_limits<long long>::min();  // Published top of an empty shard
+
+    struct alignas(64) Shard {        // One cache line per shard header
+        mutex lock;
+        MaxHeap heap;
+        atomic<long long> top{EMPTY};  // Priority of heap's root, updated under `lock`
+        atomic<long long> stolen{0};   // Orders other dispatchers took from this shard
+
+        void publish() { top.store(heap.isEmpty() ? EMPTY : heap.peekMax().priority, memory_order_release); }
+    };
+
+    vector<int> zoneOfNode;
+    vector<vector<int>> neighbours;      // Zones sharing a route with each zone
+    unique_ptr<Shard[]> shards;
+    int zoneCount;
+    int stealBatch;                      // Orders moved per steal
+    atomic<bool> closed{false};          // No more submissions
+    vector<thread> dispatchers;
+
+    // Move up to stealBatch of the victim's most urgent orders into `zone`
+    bool stealInto(int zone, int victim) {
+        vector<Order> loot;
+        {
+            lock_guard<mutex> guard(shards[victim].lock);
+            Order o;
+            while ((int)loot.size() < stealBatch && shards[victim].heap.tryExtractMax(o))
+                loot.push_back(o);
+            shards[victim].publish();
+        }
+        if (loot.empty()) return false;  // Someone emptied it first
+        shards[victim].stolen.fetch_add(loot.size(), memory_order_relaxed);
+        lock_guard<mutex> guard(shards[zone].lock);  // Never hold two shard locks at once
+        shards[zone].heap.insertBatch(loot);
+        shards[zone].publish();
+        return true;
+    }
+
+    // Victim with the highest published top among `candidates` (-1 if all empty)
+    int richestOf(const vector<int>& candidates) const {
+        int best = -1;
+        long long bestTop = EMPTY;
+        for (int z : candidates) {
+            long long t = shards[z].top.load(memory_order_acquire);
+            if (t > bestTop) { bestTop = t; best = z; }
+        }
+        return best;
+    }
+
+public:
+    // zoneOfNode[node]: zone owning that delivery location; neighbours[z]: adjacent zones
+    ZoneDispatcher(vector<int> zoneOfNode, int zoneCount, vector<vector<int>> neighbours, int stealBatch = 8)
+        : zoneOfNode(move(zoneOfNode)), neighbours(move(neighbours)),
+          shards(new Shard[max(zoneCount, 1)]), zoneCount(zoneCount), stealBatch(stealBatch) {
+        if (zoneCount <= 0) throw runtime_error("zone count must be positive, got " + to_string(zoneCount));
+    }
+
+    ~ZoneDispatcher() { finish(); }
+
+    int zones() const { return zoneCount; }
+
+    // Zone an order belongs to (orders without a location are spread by id)
+    int zoneOf(const Order& o) const {
+        if (o.node >= 0 && o.node < (int)zoneOfNode.size()) return zoneOfNode[o.node];
+        return (o.id % zoneCount + zoneCount) % zoneCount;
+    }
+
+    // Add an order from any thread; locks only the order's own shard
+    void submit(const Order& o) {
+        Shard& shard = shards[zoneOf(o)];
+        lock_guard<mutex> guard(shard.lock);
+        shard.heap.insert(o);
+        shard.publish();
+    }
+
+    // Next order for zone's dispatcher: its own most urgent order, or else a
+    // batch stolen from the busiest neighbour. Returns false if nothing is left anywhere
+    bool takeNext(int zone, Order& out) {
+        for (;;) {
+            {
+                Shard& own = shards[zone];
+                lock_guard<mutex> guard(own.lock);
+                if (own.heap.tryExtractMax(out)) {
+                    own.publish();
+                    return true;
+                }
+            }
+            int victim = richestOf(neighbours[zone]);
+            if (victim == -1) {
+                vector<int> everyone(zoneCount);
+                for (int z = 0; z < zoneCount; ++z) everyone[z] = z;
+                victim = richestOf(everyone);
+            }
+            if (victim == -1) return false;
+            stealInto(zone, victim);  // On a lost race, loop and look again
+        }
+    }
+
+    // Most urgent pending order across all zones without taking any lock
+    // Returns the zone holding it (-1 if every zone is empty) and its priority
+    // The answer is a snapshot: shards may change right after they are read
+    int mostUrgentZone(int& priority) const {
+        int best = -1;
+        long long bestTop = EMPTY;
+        for (int z = 0; z < zoneCount; ++z) {
+            long long t = shards[z].top.load(memory_order_acquire);
+            if (t > bestTop) { bestTop = t; best = z; }
+        }
+        priority = best == -1 ? -1 : (int)bestTop;
+        return best;
+    }
+
+    long long stolenFrom(int zone) const { return shards[zone].stolen.load(memory_order_relaxed); }
+
+    // Start one dispatcher thread per zone; each calls handler(zone, order)
+    // for every order it takes until finish() is called and all shards are empty
+    void start(function<void(int, const Order&)> handler) {
+        closed = false;
+        for (int z = 0; z < zoneCount; ++z) {
+            dispatchers.emplace_back([this, z, handler]() {
+                Order o;
+                IdleBackoff idle;
+                for (;;) {
+                    bool last = closed.load(memory_order_acquire);  // Read before looking for work
+                    if (takeNext(z, o)) {
+                        handler(z, o);
+                        idle.reset();
+                    } else if (last) {
+                        return;
+                    } else {
+                        idle.wait();
+                    }
+                }
+            });
+        }
+    }
+
+    // Stop accepting work once every submitted order has been handled
+    void finish() {
+        closed.store(true, memory_order_release);
+        for (thread& t : dispatchers) t.join();
+        dispatchers.clear();
+    }
+};
+
+// ----------- Core Delivery Network System -----------
+/**
+ * Main system integrating all algorithms:
+ * 1. Kruskal's MST for minimum cost network construction
+ * 2. Max Heap for priority-based order processing
+ * 3. KMP for intelligent menu recommendation
+ */
+class DeliveryNetwork {
+private:
+    int numNodes;                    // Number of delivery locations
+    vector<Edge> edges;              // All possible delivery routes
+    MaxHeap orderHeap;              // Priority queue for order management
+    vector<string> menuItems;       // Available menu items for recommendation
+    vector<Order> intakeBatch;      // Reused buffer for drainIntake
+    OrderJournal* journal = nullptr; // Write-ahead log of heap changes (optional)
+    vector<Point> locations;        // locations[node]: map coordinate of each node
+    vector<bool> hasLocation;       // Whether setLocation was called for the node
+    vector<int> restaurants;        // Nodes that host a restaurant
+    KDTree locationIndex;           // Static index over all located nodes
+    KDTree restaurantIndex;         // Static index over restaurant nodes
+    bool spatialIndexDirty = true;  // Rebuild trees lazily after location changes
+    UniformGrid courierGrid;        // Dynamic index of live courier positions
+    bool courierGridReady = false;  // Grid is sized on first use
+    RouteGraph routeGraph;          // CSR view of `edges` for shortest paths
+    bool routeGraphDirty = true;    // Rebuild CSR lazily after addRoute
+    TimeProfileStore timeProfiles;  // Shared hour-of-day cost profiles
+    long long edgesVersion = 0;     // Bumped whenever `edges` changes or is reordered
+    vector<int> slotOrder;          // Edge indices sorted by cost in slot `slotOrderSlot`
+    int slotOrderSlot = -1;
+    long long slotOrderVersion = -1; // edgesVersion that slotOrder was built for
+
+    // Remove the most urgent order, logging the removal if journaling
+    // Returns false if no order is pending
+    bool takeNextOrder(Order& o) {
+        if (!orderHeap.tryExtractMax(o)) return false;
+        if (journal) journal->recordExtract(o);
+        return true;
+    }
+
+    // Promotional routes get 20% cost reduction (truncated to whole cost units)
+    static int promoCost(int cost) {
+        return cost * 0.8;
+    }
+
+    // Cost of a route during one hour-of-day slot
+    int slotCost(const Edge& e, int slot) const {
+        return e.profile < 0 ? e.weight : timeProfiles.cost(e.profile, slot);
+    }
+
+    // Intern the route's per-slot costs (slotCosts repeated across the day,
+    // promo-discounted if hasPromo) and set its weight to their rounded mean
+    void setEdgeProfile(Edge& e, const vector<int>& slotCosts, bool hasPromo) {
+        vector<int> costs(TimeProfileStore::SLOTS);
+        long long sum = 0;
+        for (int slot = 0; slot < TimeProfileStore::SLOTS; ++slot) {
+            int c = slotCosts[slot % slotCosts.size()];
+            costs[slot] = hasPromo ? promoCost(c) : c;
+            sum += costs[slot];
+        }
+        e.profile = timeProfiles.intern(costs);
+        e.weight = (int)((sum + TimeProfileStore::SLOTS / 2) / TimeProfileStore::SLOTS);
+    }
+
+    // Edge indices sorted by their cost during `slot`
+    // Derived from the previous slot's ordering when the edges are unchanged:
+    // routes whose profile has the same cost in both slots keep their relative
+    // order, so only routes whose cost changed are re-sorted and merged back in
+    // Time Complexity: O(E + C log C) with C changed routes (O(E log E) on first use)
+    const vector<int>& edgeOrderForSlot(int slot) {
+        auto bySlotCost = [&](int a, int b) { return slotCost(edges[a], slot) < slotCost(edges[b], slot); };
+        if (slotOrderVersion != edgesVersion) {
+            slotOrder.resize(edges.size());
+            for (size_t i = 0; i < edges.size(); ++i) slotOrder[i] = i;
+            sort(slotOrder.begin(), slotOrder.end(), bySlotCost);
+        } else if (slotOrderSlot != slot) {
+            vector<bool> profileChanged(timeProfiles.count());
+            for (int p = 0; p < timeProfiles.count(); ++p)
+                profileChanged[p] = timeProfiles.cost(p, slotOrderSlot) != timeProfiles.cost(p, slot);
+            vector<int> kept, moved;
+            for (int i : slotOrder) {
+                int profile = edges[i].profile;
+                (profile >= 0 && profileChanged[profile] ? moved : kept).push_back(i);
+            }
+            if (!moved.empty()) {
+                sort(moved.begin(), moved.end(), bySlotCost);
+                merge(kept.begin(), kept.end(), moved.begin(), moved.end(), slotOrder.begin(), bySlotCost);
+            }
+        }
+        slotOrderSlot = slot;
+        slotOrderVersion = edgesVersion;
+        return slotOrder;
+    }
+
+    const RouteGraph& ensureRouteGraph() {
+        if (routeGraphDirty) {
+            routeGraph.build(numNodes, edges);
+            routeGraphDirty = false;
+        }
+        return routeGraph;
+    }
+
+    // Bulk-load both k-d trees if locations changed since the last query
+    void ensureSpatialIndex() {
+        if (!spatialIndexDirty) return;
+        vector<pair<int, Point>> all, food;
+        for (int node = 0; node < numNodes; ++node)
+            if (hasLocation[node]) all.push_back({node, locations[node]});
+        for (int node : restaurants)
+            if (hasLocation[node]) food.push_back({node, locations[node]});
+        locationIndex.build(all);
+        restaurantIndex.build(food);
+        spatialIndexDirty = false;
+    }
+
+public:
+    DeliveryNetwork(int numNodes)
+        : numNodes(numNodes), locations(numNodes), hasLocation(numNodes, false) {}
+
+    // Assign a map coordinate to a delivery location (node)
+    void setLocation(int node, double x, double y) {
+        locations[node] = {x, y};
+        hasLocation[node] = true;
+        spatialIndexDirty = true;
+    }
+
+    // Mark a located node as hosting a restaurant
+    void addRestaurant(int node) {
+        restaurants.push_back(node);
+        spatialIndexDirty = true;
+    }
+
+    // Size the courier grid to the service area; cellSize should be around
+    // the typical distance between neighbouring couriers
+    void setServiceArea(double minX, double minY, double maxX, double maxY, double cellSize) {
+        UniformGrid grid(minX, minY, maxX, maxY, cellSize);
+        for (int courier = 0; courierGridReady && courier < courierGrid.idCapacity(); ++courier)
+            if (courierGrid.contains(courier)) grid.update(courier, courierGrid.positionOf(courier));
+        courierGrid = grid;
+        courierGridReady = true;
+    }
+
+    // Record a courier's latest GPS position (called at high frequency)
+    // Time Complexity: O(1)
+    void updateCourierPosition(int courierId, double x, double y) {
+        if (!courierGridReady) {
+            // Default service area: bounding box of located nodes, 64 cells across
+            double minX = 0, minY = 0, maxX = 1, maxY = 1;
+            bool first = true;
+            for (int node = 0; node < numNodes; ++node) {
+                if (!hasLocation[node]) continue;
+                const Point& p = locations[node];
+                if (first) { minX = maxX = p.x; minY = maxY = p.y; first = false; }
+                minX = min(minX, p.x); maxX = max(maxX, p.x);
+                minY = min(minY, p.y); maxY = max(maxY, p.y);
+            }
+            double extent = max(max(maxX - minX, maxY - minY), 1.0);
+            setServiceArea(minX, minY, minX + extent, minY + extent, extent / 64);
+        }
+        courierGrid.update(courierId, {x, y});
+    }
+
+    // Last reported position of a courier
+    Point courierPosition(int courierId) const {
+        return courierGrid.positionOf(courierId);
+    }
+
+    // Take a courier off shift (no longer returned by nearestCouriers)
+    void removeCourier(int courierId) {
+        courierGrid.remove(courierId);
+    }
+
+    // The k located nodes closest to (x, y), nearest first
+    vector<int> nearestLocations(double x, double y, int k) {
+        ensureSpatialIndex();
+        return locationIndex.nearest({x, y}, k);
+    }
+
+    // All located nodes within `radius` of (x, y)
+    vector<int> locationsWithinRadius(double x, double y, double radius) {
+        ensureSpatialIndex();
+        return locationIndex.radiusQuery({x, y}, radius);
+    }
+
+    // The k restaurants closest to (x, y), nearest first
+    vector<int> nearestRestaurants(double x, double y, int k) {
+        ensureSpatialIndex();
+        return restaurantIndex.nearest({x, y}, k);
+    }
+
+    // The k available couriers closest to a node, nearest first
+    vector<int> nearestCouriers(int node, int k) {
+        return courierGrid.nearest(locations[node], k);
+    }
+
+    // All couriers within `radius` of a node
+    vector<int> couriersWithinRadius(int node, double radius) {
+        return courierGrid.radiusQuery(locations[node], radius);
+    }
+
+    // Add delivery route with optional promotional discount
+    // Promotional routes get 20% cost reduction
+    void addRoute(int u, int v, int cost, bool hasPromo = false) {
+        if (hasPromo) cost = promoCost(cost);  // Apply 20% discount for promotional routes
+        edges.push_back(Edge(u, v, cost));
+        routeGraphDirty = true;
+        edgesVersion++;
+    }
+
+    // Add a route whose cost varies by hour of day
+    // slotCosts: one cost per hour (a shorter list repeats cyclically, and
+    // an empty list is rejected before the route is added)
+    // The route's all-day weight is the rounded mean, used where no time is given
+    void addTimedRoute(int u, int v, const vector<int>& slotCosts, bool hasPromo = false) {
+        if (slotCosts.empty()) throw runtime_error("time profile needs at least one slot cost");
+        edges.push_back(Edge(u, v, 0));
+        setEdgeProfile(edges.back(), slotCosts, hasPromo);
+        routeGraphDirty = true;
+        edgesVersion++;
+    }
+
+    // Attach an hour-of-day cost profile to an existing route
+    // Returns false if no route connects u and v; an empty profile is rejected
+    bool setRouteProfile(int u, int v, const vector<int>& slotCosts, bool hasPromo = false) {
+        if (slotCosts.empty()) throw runtime_error("time profile needs at least one slot cost");
+        for (Edge& e : edges) {
+            if ((e.u == u && e.v == v) || (e.u == v && e.v == u)) {
+                setEdgeProfile(e, slotCosts, hasPromo);
+                routeGraphDirty = true;
+                edgesVersion++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Add order to priority queue for processing
+    // node: delivery location, needed only for dispatch planning
+    void addOrder(int id, int priority, int node = -1) {
+        Order o(id, priority, node);
+        if (journal) journal->recordAdd(o);
+        orderHeap.insert(o);
+    }
+
+    // Log every heap change to `j` from now on, after restoring the orders
+    // it recovered with one bulk heapify
+    // Attach before adding orders: orders already in the heap are not journaled
+    void attachJournal(OrderJournal& j) {
+        journal = &j;
+        orderHeap.insertBatch(j.recoveredOrders());
+    }
+
+    // Move up to maxBatch orders published by intake threads into the order heap
+    // Must be called from the single dispatcher thread; returns how many were moved
+    int drainIntake(MpmcRingBuffer<Order>& intake, int maxBatch) {
+        intakeBatch.clear();
+        intake.popBatch(intakeBatch, maxBatch);
+        if (journal)
+            for (const Order& o : intakeBatch) journal->recordAdd(o);
+        if (!intakeBatch.empty()) orderHeap.insertBatch(intakeBatch);
+        return intakeBatch.size();
+    }
+
+    // Process all orders in priority order (highest priority first)
+    // Uses max heap to ensure optimal order processing sequence
+    void processOrders() {
+        cout << "\nProcessing Orders by Priority:\n";
+        Order o;
+        while (takeNextOrder(o)) {  // Get highest priority order
+            cout << "Order ID: " << o.id << ", Priority: " << o.priority << "\n";
+        }
+    }
+
+    // Process up to maxOrders orders in priority order without printing
+    // Appends them to `processed` and returns how many were taken
+    int processOrders(int maxOrders, vector<Order>& processed) {
+        int taken = 0;
+        Order o;
+        while (taken < maxOrders && takeNextOrder(o)) {
+            processed.push_back(o);
+            taken++;
+        }
+        return taken;
+    }
+
+    bool hasPendingOrders() {
+        return !orderHeap.isEmpty();
+    }
+
+    // Change the cost of an existing route (e.g. traffic), in both directions
+    // The new cost applies all day, replacing any time-of-day profile
+    // Returns false if no route connects u and v
+    bool updateRouteCost(int u, int v, int cost) {
+        for (Edge& e : edges) {
+            if ((e.u == u && e.v == v) || (e.u == v && e.v == u)) {
+                e.weight = cost;
+                e.profile = -1;  // A fixed cost overrides any time-of-day profile
+                routeGraphDirty = true;
+                edgesVersion++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Add menu item to recommendation system
+    void addMenuItem(string item) {
+        menuItems.push_back(item);
+    }
+
+    // Recommend menu items containing specified keyword
+    // Uses KMP algorithm for efficient string matching
+    void recommendMenus(string keyword) {
+        cout << "\nMenu Recommendations for: " << keyword << "\n";
+        for (const string& item : findMenus(keyword))
+            cout << "- " << item << "\n";
+    }
+
+    // Menu items containing keyword, in insertion order (no printing)
+    vector<string> findMenus(const string& keyword) const {
+        vector<string> matches;
+        for (const string& item : menuItems) {
+            // Use KMP algorithm to check if menu item contains keyword
+            if (MenuRecommender::containsKeyword(item, keyword))
+                matches.push_back(item);
+        }
+        return matches;
+    }
+
+    // Shortest travel cost between two locations over the route graph
+    // Returns -1 if `to` is unreachable from `from`
+    long long travelCost(int from, int to) {
+        vector<long long> dist;
+        ensureRouteGraph().shortestPaths(from, dist);
+        return dist[to] == RouteGraph::UNREACHABLE ? -1 : dist[to];
+    }
+
+    // Multiply the cost of the first route touching node u by `factor`
+    // Returns false if no route touches u
+    bool rescaleRouteFrom(int u, double factor) {
+        for (Edge& e : edges) {
+            if (e.u == u || e.v == u) {
+                e.weight = max(1, (int)(e.weight * factor));
+                e.profile = -1;
+                routeGraphDirty = true;
+                edgesVersion++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Split the locations into `zones` connected-ish delivery zones
+    // Seeds are spread along a BFS order; every node joins the zone of the
+    // nearest seed in hops (multi-source BFS). Returns zoneOf[node]
+    // and fills neighbours[z] with the zones sharing a route with zone z
+    vector<int> partitionZones(int zones, vector<vector<int>>& neighbours) {
+        if (zones <= 0) throw runtime_error("zone count must be positive, got " + to_string(zones));
+        const RouteGraph& graph = ensureRouteGraph();
+        vector<int> bfsOrder, zoneOf(numNodes, -1);
+        vector<bool> seen(numNodes, false);
+        for (int root = 0; root < numNodes; ++root) {
+            if (seen[root]) continue;
+            seen[root] = true;
+            bfsOrder.push_back(root);
+            for (size_t head = bfsOrder.size() - 1; head < bfsOrder.size(); ++head)
+                for (auto arc = graph.neighbors(bfsOrder[head]); arc.valid(); arc.next())
+                    if (!seen[arc.target()]) { seen[arc.target()] = true; bfsOrder.push_back(arc.target()); }
+        }
+        vector<int> frontier;
+        for (int z = 0; z < zones && z < numNodes; ++z) {
+            int seed = bfsOrder[(size_t)z * numNodes / zones];
+            zoneOf[seed] = z;
+            frontier.push_back(seed);
+        }
+        for (size_t head = 0; head < frontier.size(); ++head)
+            for (auto arc = graph.neighbors(frontier[head]); arc.valid(); arc.next())
+                if (zoneOf[arc.target()] == -1) {
+                    zoneOf[arc.target()] = zoneOf[frontier[head]];
+                    frontier.push_back(arc.target());
+                }
+        for (int node = 0; node < numNodes; ++node)
+            if (zoneOf[node] == -1) zoneOf[node] = node % zones;  // Isolated nodes
+        neighbours.assign(zones, {});
+        for (const Edge& e : edges) {
+            int a = zoneOf[e.u], b = zoneOf[e.v];
+            if (a == b) continue;
+            if (find(neighbours[a].begin(), neighbours[a].end(), b) == neighbours[a].end()) neighbours[a].push_back(b);
+            if (find(neighbours[b].begin(), neighbours[b].end(), a) == neighbours[b].end()) neighbours[b].push_back(a);
+        }
+        return zoneOf;
+    }
+
+    // Zone-sharded dispatcher over `zones` zones of this network
+    unique_ptr<ZoneDispatcher> makeZoneDispatcher(int zones) {
+        vector<vector<int>> neighbours;
+        vector<int> zoneOf = partitionZones(zones, neighbours);
+        return unique_ptr<ZoneDispatcher>(new ZoneDispatcher(zoneOf, zones, neighbours));
+    }
+
+    // Move every pending order from the city-wide heap into its zone shard
+    // The move is not journaled: orders stay pending in the journal until a
+    // zone dispatcher started with startZoneDispatch has handled them
+    int shardPendingOrders(ZoneDispatcher& zones) {
+        int moved = 0;
+        Order o;
+        while (orderHeap.tryExtractMax(o)) {
+            zones.submit(o);
+            moved++;
+        }
+        return moved;
+    }
+
+    // Start zones' dispatcher threads; each order is journaled as extracted
+    // after handler(zone, order) returns, so a crash before that recovers it
+    void startZoneDispatch(ZoneDispatcher& zones, function<void(int, const Order&)> handler) {
+        OrderJournal* log = journal;
+        zones.start([log, handler](int zone, const Order& o) {
+            handler(zone, o);
+            if (log) log->recordExtract(o);
+        });
+    }
+
+    // Compressed, renumbered copy of the route graph (see CompressedRouteGraph)
+    // Time-of-day profiles are not carried over: arcs keep their all-day weight
+    CompressedRouteGraph compressRoutes(NodeOrder order = NodeOrder::RCM) {
+        CompressedRouteGraph compressed;
+        compressed.build(ensureRouteGraph(), order);
+        return compressed;
+    }
+
+    // Earliest-arrival travel time from `from` to `to` when departing at
+    // `departureMinute` of the day, following time-of-day route profiles
+    // Returns -1 if `to` is unreachable
+    double travelTimeAt(int from, int to, double departureMinute) {
+        vector<double> arrival;
+        ensureRouteGraph().earliestArrivals(from, departureMinute, timeProfiles, arrival);
+        return isinf(arrival[to]) ? -1 : arrival[to] - departureMinute;
+    }
+
+    // Shortest travel cost from one location to every location
+    void travelCostsFrom(int from, vector<long long>& dist) {
+        ensureRouteGraph().shortestPaths(from, dist);
+    }
+
+    Point locationOf(int node) const {
+        return locations[node];
+    }
+
+    int size() const {
+        return numNodes;
+    }
+
+    // Group every pending order into capacity-limited courier routes from `depot`
+    // 1. Drain the order heap and batch orders sharing a delivery node into one stop
+    // 2. Build the stop-to-stop travel cost matrix with one Dijkstra per stop (in parallel)
+    // 3. Savings construction, then 2-opt / Or-opt until `budgetMs` has elapsed
+    // Orders without a location or unreachable from the depot stay in the heap
+    DispatchPlan planDispatch(int depot, int capacity, int budgetMs = 200) {
+        if (capacity <= 0) throw runtime_error("courier capacity must be positive, got " + to_string(capacity));
+        if (depot < 0 || depot >= numNodes) throw runtime_error("invalid depot node " + to_string(depot));
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(budgetMs);
+        int threads = max(1u, thread::hardware_concurrency());
+        DispatchPlan plan;
+
+        // Matrix points: depot first, then each distinct delivery node
+        vector<int> pointOfNode(numNodes, -1), nodeOfPoint = {depot};
+        pointOfNode[depot] = 0;
+        vector<Order> located;
+        Order o;
+        while (orderHeap.tryExtractMax(o)) {  // Highest priority first, so stops list urgent orders first
+            if (o.node < 0 || o.node >= numNodes) { plan.unassigned.push_back(o); continue; }
+            if (pointOfNode[o.node] == -1) {
+                pointOfNode[o.node] = nodeOfPoint.size();
+                nodeOfPoint.push_back(o.node);
+            }
+            located.push_back(o);
+        }
+
+        const RouteGraph& graph = ensureRouteGraph();
+        int m = nodeOfPoint.size();
+        vector<int> matrix((size_t)m * m);
+        vector<bool> reachable(m, true);
+        atomic<int> nextRow{0};
+        auto fillRows = [&]() {
+            vector<long long> dist;
+            for (int row = nextRow++; row < m; row = nextRow++) {
+                graph.shortestPaths(nodeOfPoint[row], dist);
+                for (int col = 0; col < m; ++col) {
+                    long long d = dist[nodeOfPoint[col]];
+                    // Saturate so that unreachable pairs never look attractive
+                    const long long cap = numeric_limits<int>::max() / 4;
+                    matrix[(size_t)row * m + col] = (int)min(d, cap);
+                    if (row == 0 && d == RouteGraph::UNREACHABLE) reachable[col] = false;
+                }
+            }
+        };
+        vector<thread> pool;
+        for (int t = 1; t < min(threads, m); ++t) pool.emplace_back(fillRows);
+        fillRows();
+        for (thread& t : pool) t.join();
+
+        // Stops: each node's orders split into chunks of at most `capacity`
+        vector<int> pointOfStop = {0}, demand = {0};
+        vector<vector<Order>> ordersAtStop = {{}};
+        vector<int> openStop(m, -1);
+        for (const Order& o : located) {
+            int point = pointOfNode[o.node];
+            if (!reachable[point]) { plan.unassigned.push_back(o); continue; }
+            int stop = openStop[point];
+            if (stop == -1 || demand[stop] >= capacity) {
+                stop = openStop[point] = pointOfStop.size();
+                pointOfStop.push_back(point);
+                demand.push_back(0);
+                ordersAtStop.push_back({});
+            }
+            demand[stop]++;
+            ordersAtStop[stop].push_back(o);
+        }
+        for (const Order& o : plan.unassigned) orderHeap.insert(o);  // Back in the heap, never left the journal
+
+        DispatchOptimizer optimizer(matrix, m, pointOfStop);
+        vector<vector<int>> routes = optimizer.construct(demand, capacity);
+        for (const auto& r : routes) plan.initialCost += optimizer.routeCost(r);
+        optimizer.improve(routes, demand, capacity, deadline, threads);
+
+        for (const auto& r : routes) {
+            CourierRoute route;
+            route.cost = optimizer.routeCost(r);
+            for (int stop : r) {
+                route.stops.push_back(nodeOfPoint[pointOfStop[stop]]);
+                for (const Order& o : ordersAtStop[stop]) {
+                    if (journal) journal->recordExtract(o);
+                    route.orderIds.push_back(o.id);
+                    route.urgency = max(route.urgency, o.priority);
+                }
+            }
+            plan.totalCost += route.cost;
+            plan.routes.push_back(move(route));
+        }
+        stable_sort(plan.routes.begin(), plan.routes.end(),
+                    [](const CourierRoute& a, const CourierRoute& b) { return a.urgency > b.urgency; });
+
+        // Hand the most urgent routes to the couriers closest to the depot
+        if (courierGridReady) {
+            vector<int> couriers = courierGrid.nearest(locations[depot], plan.routes.size());
+            for (size_t r = 0; r < couriers.size(); ++r) plan.routes[r].courier = couriers[r];
+        }
+        return plan;
+    }
+
+    // Build minimum spanning tree using Kruskal's algorithm
+    // Returns minimum cost to connect all delivery locations
+    // Time Complexity: O(E log E) where E is number of edges
+    int buildMinimumCostNetwork() {
+        vector<Edge> selected;
+        int totalCost = computeMinimumCostNetwork(&selected);
+        cout << "\nSelected Routes in Minimum Cost Network:\n";
+        for (const Edge& e : selected)
+            cout << "Route: " << e.u << " <-> " << e.v << " | Cost: " << e.weight << "\n";
+        return totalCost;
+    }
+
+    // Kruskal's algorithm without printing; optionally reports the chosen routes
+    int computeMinimumCostNetwork(vector<Edge>* selected = nullptr) {
+        // Step 1: Sort all edges by weight in ascending order
+        sort(edges.begin(), edges.end());
+        edgesVersion++;  // Indices into `edges` moved
+        
+        // Step 2: Initialize disjoint set for cycle detection
+        DisjointSet ds(numNodes);
+
+        int totalCost = 0;
+        
+        // Step 3: Process edges in sorted order (Kruskal's algorithm)
+        for (const Edge& e : edges) {
+            // Check if adding this edge creates a cycle
+            if (ds.find(e.u) != ds.find(e.v)) {
+                ds.unite(e.u, e.v);          // Add edge to MST
+                totalCost += e.weight;        // Add cost to total
+                if (selected) selected->push_back(e);
+            }
+            // If edge creates cycle, skip it (greedy choice)
+        }
+        return totalCost;
+    }
+
+    // Minimum spanning tree for the route costs of one hour-of-day slot (0-23)
+    // Reuses the sorted edge order of the previous slot where profiles agree
+    // Time Complexity: O(E α(V)) plus the re-sort of routes whose cost changed
+    int buildMinimumCostNetwork(int timeSlot) {
+        vector<Edge> selected;
+        int totalCost = computeMinimumCostNetwork(timeSlot, &selected);
+        cout << "\nSelected Routes in Minimum Cost Network at " << timeSlot << ":00:\n";
+        for (const Edge& e : selected)
+            cout << "Route: " << e.u << " <-> " << e.v << " | Cost: " << e.weight << "\n";
+        return totalCost;
+    }
+
+    // Per-slot Kruskal without printing; selected routes carry their slot cost
+    int computeMinimumCostNetwork(int timeSlot, vector<Edge>* selected) {
+        const vector<int>& order = edgeOrderForSlot(timeSlot);
+        DisjointSet ds(numNodes);
+        int totalCost = 0;
+        for (int i : order) {
+            const Edge& e = edges[i];
+            if (ds.find(e.u) != ds.find(e.v)) {
+                ds.unite(e.u, e.v);
+                int cost = slotCost(e, timeSlot);
+                totalCost += cost;
+                if (selected) selected->push_back(Edge(e.u, e.v, cost, e.profile));
+            }
+        }
+        return totalCost;
+    }
+};
+
+// ----------- Concurrent Order Intake Pipeline -----------
+/**
+ * Decouples order intake from dispatch:
+ * - any number of intake threads call submit(), which is one lock-free push
+ *   into a bounded MPMC ring buffer and never blocks (false = buffer full)
+ * - one dispatcher thread owns the DeliveryNetwork: it drains the ring in
+ *   batches into the order heap, then processes the most urgent orders
+ */
+class OrderPipeline {
+private:
+    DeliveryNetwork& network;
+    MpmcRingBuffer<Order> intake;
+    int batchSize;                            // Max orders moved/processed per round
+    function<void(const Order&)> onDispatch;  // Called on the dispatcher thread
+    atomic<bool> running{false};
+    atomic<long long> rejected{0};            // Submits refused because the ring was full
+    thread dispatcher;
+
+    void dispatchLoop() {
+        vector<Order> processed;
+        IdleBackoff idle;
+        for (;;) {
+            // Read the flag before draining so nothing submitted before stop() is missed
+            bool stopping = !running.load(memory_order_acquire);
+            int moved = network.drainIntake(intake, batchSize);
+            processed.clear();
+            network.processOrders(batchSize, processed);
+            for (const Order& o : processed) onDispatch(o);
+            if (moved == 0 && processed.empty()) {
+                if (stopping) return;
+                idle.wait();
+            } else {
+                idle.reset();
+            }
+        }
+    }
+
+public:
+    OrderPipeline(DeliveryNetwork& network, size_t capacity, int batchSize,
+                  function<void(const Order&)> onDispatch)
+        : network(network), intake(capacity), batchSize(batchSize), onDispatch(move(onDispatch)) {}
+
+    ~OrderPipeline() { stop(); }
+
+    void start() {
+        running = true;
+        dispatcher = thread(&OrderPipeline::dispatchLoop, this);
+    }
+
+    // Let the dispatcher finish everything already submitted, then join it
+    void stop() {
+        running.store(false, memory_order_release);
+        if (dispatcher.joinable()) dispatcher.join();
+    }
+
+    // Publish an order from any thread; never blocks
+    // Returns false if the ring is full so the caller can shed load or retry
+    bool submit(const Order& order) {
+        if (intake.tryPush(order)) return true;
+        rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    long long rejectedCount() const { return rejected.load(memory_order_relaxed); }
+};
+
+// ----------- Calendar Queue for Discrete-Event Simulation -----------
+/**
+ * Brown's calendar queue: a priority queue of timestamped events laid out
+ * like a desk calendar. Bucket i holds events whose time falls on "day" i
+ * of any "year" (year = bucketCount * bucketWidth). Dequeue scans forward
+ * from the current day and only takes events belonging to the current year
+ * The bucket count doubles/halves with the queue size and the day width is
+ * re-estimated from the event spacing, so both operations stay O(1) on average
+ */
+template <class Event>
+class CalendarQueue {
+private:
+    vector<vector<Event>> buckets;  // Unsorted events per day
+    double width = 1.0;             // Length of one day
+    size_t mask = 0;                // bucketCount - 1 (bucket count is a power of two)
+    size_t current = 0;             // Day being scanned
+    double currentTop = 1.0;        // End time of the current day in the current year
+    size_t count = 0;
+
+    size_t bucketOf(double time) const {
+        return (size_t)(long long)(time / width) & mask;
+    }
+
+    // Rebuild with `bucketCount` days, re-estimating the day width from the
+    // average gap between the earliest events
+    void resize(size_t bucketCount) {
+        vector<Event> all;
+        all.reserve(count);
+        for (auto& bucket : buckets)
+            for (auto& e : bucket) all.push_back(e);
+        size_t sample = min<size_t>(all.size(), 64);
+        if (sample > 1) {
+            partial_sort(all.begin(), all.begin() + sample, all.end(),
+                         [](const Event& a, const Event& b) { return a.time < b.time; });
+            double gap = (all[sample - 1].time - all[0].time) / (sample - 1);
+            if (gap > 0) width = 3.0 * gap;  // Brown's rule: ~3 events per day
+        }
+        buckets.assign(bucketCount, vector<Event>());
+        mask = bucketCount - 1;
+        double start = all.empty() ? currentTop - width : all[0].time;
+        for (auto& e : all) buckets[bucketOf(e.time)].push_back(e);
+        current = bucketOf(start);
+        currentTop = (floor(start / width) + 1) * width;
+    }
+
+public:
+    CalendarQueue() : buckets(2), mask(1) {}
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    // Time Complexity: O(1) amortized
+    void push(const Event& e) {
+        buckets[bucketOf(e.time)].push_back(e);
+        count++;
+        // An event scheduled before the current day moves the scan position back
+        if (e.time < currentTop - width) {
+            current = bucketOf(e.time);
+            currentTop = (floor(e.time / width) + 1) * width;
+        }
+        if (count > 2 * buckets.size()) resize(buckets.size() * 2);
+    }
+
+    // Remove and return the earliest event (queue must not be empty)
+    // Time Complexity: O(1) amortized when the day width fits the event spacing
+    Event pop() {
+        for (size_t scanned = 0; scanned <= mask; ++scanned) {
+            vector<Event>& bucket = buckets[current];
+            size_t best = bucket.size();
+            for (size_t i = 0; i < bucket.size(); ++i)
+                if (bucket[i].time < currentTop && (best == bucket.size() || bucket[i].time < bucket[best].time))
+                    best = i;
+            if (best != bucket.size()) return take(bucket, best);
+            current = (current + 1) & mask;  // Next day
+            currentTop += width;
+        }
+        // A whole year was empty: jump straight to the earliest event
+        size_t bestBucket = 0, best = 0;
+        double bestTime = numeric_limits<double>::infinity();
+        for (size_t b = 0; b < buckets.size(); ++b)
+            for (size_t i = 0; i < buckets[b].size(); ++i)
+                if (buckets[b][i].time < bestTime) { bestTime = buckets[b][i].time; bestBucket = b; best = i; }
+        current = bestBucket;
+        currentTop = (floor(bestTime / width) + 1) * width;
+        return take(buckets[bestBucket], best);
+    }
+
+private:
+    Event take(vector<Event>& bucket, size_t index) {
+        Event e = bucket[index];
+        bucket[index] = bucket.back();  // Swap-remove: order inside a day is irrelevant
+        bucket.pop_back();
+        count--;
+        if (buckets.size() > 2 && count < buckets.size() / 2) resize(buckets.size() / 2);
+        return e;
+    }
+};
+
+// ----------- Discrete-Event Load Simulator -----------
+/**
+ * Load generator for DeliveryNetwork driven by a calendar queue of events:
+ * - order arrivals (Poisson process or a replayed trace) call addOrder
+ * - dispatch ticks call processOrders in batches and send the nearest courier
+ * - courier moves (GPS pings and completed deliveries) call updateCourierPosition
+ * - route changes call updateRouteCost and invalidate cached travel costs
+ * Reports simulator throughput (events per wall-clock second) and percentiles
+ * of order waiting time (arrival -> dispatch) and delivery time (arrival -> drop-off)
+ * Orders still undispatched at the end (dispatchBatch caps each tick) are reported
+ * as a backlog with their ages, and as censored waits in a combined percentile line
+ * Trace rows with a negative time or id, or a node outside the network, are skipped;
+ * trace ids are renumbered densely in arrival order
+ */
+struct SimulationConfig {
+    double arrivalRate = 200.0;      // Orders per simulated second (Poisson)
+    double duration = 3600.0;        // Simulated seconds
+    double dispatchInterval = 1.0;   // Seconds between dispatch ticks
+    int dispatchBatch = 500;         // Max orders taken per tick
+    int couriers = 400;              // Couriers sending GPS pings
+    double gpsInterval = 5.0;        // Seconds between pings of one courier
+    double routeChangeRate = 0.05;   // Route cost changes per simulated second
+    int depot = 0;                   // Node the travel costs are measured from
+    string tracePath;                // If set, replay "time id priority node" lines instead of Poisson
+    unsigned seed = 1;
+};
+
+struct SimulationReport {
+    long long events = 0;
+    long long ordersArrived = 0;
+    long long ordersDispatched = 0;
+    long long ordersDelivered = 0;
+    long long traceRowsSkipped = 0;
+    double wallSeconds = 0;
+    vector<double> waitTimes;      // Arrival -> dispatch, simulated seconds
+    vector<double> deliveryTimes;  // Arrival -> drop-off, simulated seconds
+    vector<double> backlogAges;    // Arrival -> end of run, orders never dispatched
+
+    double eventsPerSecond() const { return wallSeconds > 0 ? events / wallSeconds : 0; }
+
+    // p in [0, 100]; sorts a copy lazily via nth_element
+    static double percentile(vector<double> values, double p) {
+        if (values.empty()) return 0;
+        size_t k = min(values.size() - 1, (size_t)(p / 100.0 * values.size()));
+        nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    }
+
+    void print() const {
+        cout << "Events processed:     " << events << " in " << wallSeconds << " s ("
+             << (long long)eventsPerSecond() << " events/s)\n";
+        cout << "Orders arrived/dispatched/delivered: " << ordersArrived << " / "
+             << ordersDispatched << " / " << ordersDelivered << "\n";
+        if (traceRowsSkipped > 0) cout << "Trace rows skipped (invalid): " << traceRowsSkipped << "\n";
+        const double ps[] = {50, 90, 99, 99.9};
+        cout << "Wait time (s):     ";
+        for (double p : ps) cout << " p" << p << "=" << percentile(waitTimes, p);
+        cout << "\nDelivery time (s): ";
+        for (double p : ps) cout << " p" << p << "=" << percentile(deliveryTimes, p);
+        cout << "\nUndispatched backlog: " << backlogAges.size() << " orders";
+        if (!backlogAges.empty()) {
+            cout << ", age (s):";
+            for (double p : ps) cout << " p" << p << "=" << percentile(backlogAges, p);
+            // Backlog ages are lower bounds on the final wait (right-censored)
+            vector<double> all = waitTimes;
+            all.insert(all.end(), backlogAges.begin(), backlogAges.end());
+            cout << "\nWait incl. backlog (s):";
+            for (double p : ps) cout << " p" << p << "=" << percentile(all, p);
+        }
+        cout << "\n";
+    }
+};
+
+class DeliverySimulator {
+private:
+    enum EventType : int { ORDER_ARRIVAL, DISPATCH_TICK, COURIER_PING, DELIVERY_DONE, ROUTE_CHANGE };
+
+    struct Event {
+        double time;
+        EventType type;
+        int a, b, c;  // Payload: (order id, priority, node) / (courier, node, order id) / ...
+    };
+
+    DeliveryNetwork& network;
+    SimulationConfig config;
+    CalendarQueue<Event> queue;
+    mt19937_64 rng;
+    vector<double> arrivalTime;        // arrivalTime[order id]
+    vector<char> dispatched;           // dispatched[order id]
+    vector<long long> depotCost;       // Travel cost from the depot, cached between route changes
+    bool depotCostValid = false;
+    vector<array<double, 4>> trace;    // Replayed (time, id, priority, node) rows
+    size_t nextTraceRow = 0;
+    int nextOrderId = 0;
+    vector<Order> batch;               // Reused buffer for processOrders
+
+    void schedule(double time, EventType type, int a = 0, int b = 0, int c = 0) {
+        if (time <= config.duration) queue.push({time, type, a, b, c});
+    }
+
+    // Queue the next arrival (one pending arrival at a time keeps the queue small)
+    void scheduleNextArrival(double now) {
+        if (!config.tracePath.empty()) {
+            if (nextTraceRow < trace.size()) {
+                const auto& row = trace[nextTraceRow++];
+                schedule(row[0], ORDER_ARRIVAL, (int)row[1], (int)row[2], (int)row[3]);
+            }
+            return;
+        }
+        exponential_distribution<double> gap(config.arrivalRate);
+        uniform_int_distribution<int> priority(1, 10), node(0, network.size() - 1);
+        schedule(now + gap(rng), ORDER_ARRIVAL, nextOrderId++, priority(rng), node(rng));
+    }
+
+    bool validNode(int node) const {
+        return node >= 0 && node < network.size();
+    }
+
+    void loadTrace(SimulationReport& report) {
+        ifstream in(config.tracePath);
+        if (!in) throw runtime_error("cannot open trace " + config.tracePath);
+        double time, id, priority, node;
+        while (in >> time >> id >> priority >> node) {
+            if (!(time >= 0) || !(id >= 0) || !(node >= 0 && node < network.size()) ||
+                !(fabs(priority) <= numeric_limits<int>::max())) {
+                report.traceRowsSkipped++;
+                continue;
+            }
+            trace.push_back({time, id, priority, node});
+        }
+        sort(trace.begin(), trace.end());
+        // Dense ids keep arrivalTime/dispatched small whatever ids the trace uses
+        for (size_t i = 0; i < trace.size(); ++i) trace[i][1] = (double)i;
+    }
+
+    void handle(const Event& e, SimulationReport& report) {
+        switch (e.type) {
+        case ORDER_ARRIVAL:
+            if (e.a >= (int)arrivalTime.size()) {
+                arrivalTime.resize(e.a + 1, 0);
+                dispatched.resize(e.a + 1, 0);
+            }
+            arrivalTime[e.a] = e.time;
+            network.addOrder(e.a, e.b, e.c);
+            report.ordersArrived++;
+            scheduleNextArrival(e.time);
+            break;
+        case DISPATCH_TICK: {
+            batch.clear();
+            network.processOrders(config.dispatchBatch, batch);
+            if (!batch.empty() && !depotCostValid) {
+                network.travelCostsFrom(config.depot, depotCost);
+                depotCostValid = true;
+            }
+            for (const Order& o : batch) {
+                report.waitTimes.push_back(e.time - arrivalTime[o.id]);
+                report.ordersDispatched++;
+                dispatched[o.id] = 1;
+                int courier = -1;
+                double travel = 3600.0;  // Fallback for orders without a usable node
+                if (validNode(o.node)) {
+                    vector<int> nearest = network.nearestCouriers(o.node, 1);
+                    if (!nearest.empty()) courier = nearest[0];
+                    long long cost = depotCost[o.node];
+                    if (cost != RouteGraph::UNREACHABLE) travel = (double)cost;
+                }
+                schedule(e.time + travel, DELIVERY_DONE, courier, o.node, o.id);
+            }
+            schedule(e.time + config.dispatchInterval, DISPATCH_TICK);
+            break;
+        }
+        case COURIER_PING: {
+            // Small GPS drift around the last known position
+            normal_distribution<double> drift(0.0, 20.0);
+            Point p = network.courierPosition(e.a);
+            network.updateCourierPosition(e.a, p.x + drift(rng), p.y + drift(rng));
+            schedule(e.time + config.gpsInterval, COURIER_PING, e.a);
+            break;
+        }
+        case DELIVERY_DONE:
+            report.deliveryTimes.push_back(e.time - arrivalTime[e.c]);
+            report.ordersDelivered++;
+            if (e.a >= 0 && validNode(e.b)) {
+                Point drop = network.locationOf(e.b);
+                network.updateCourierPosition(e.a, drop.x, drop.y);  // Courier is now at the drop-off
+            }
+            break;
+        case ROUTE_CHANGE: {
+            uniform_int_distribution<int> node(0, network.size() - 1), factor(50, 200);
+            int u = node(rng);
+            // Scale the cost of some route leaving u (traffic builds up or clears)
+            if (network.rescaleRouteFrom(u, factor(rng) / 100.0)) depotCostValid = false;
+            exponential_distribution<double> gap(config.routeChangeRate);
+            schedule(e.time + gap(rng), ROUTE_CHANGE);
+            break;
+        }
+        }
+    }
+
+public:
+    DeliverySimulator(DeliveryNetwork& network, SimulationConfig config)
+        : network(network), config(move(config)), rng(this->config.seed) {}
+
+    // Run until the simulated duration elapses or no events remain
+    SimulationReport run() {
+        SimulationReport report;
+        if (!config.tracePath.empty()) loadTrace(report);
+
+        // Seed couriers at random locations, with staggered GPS pings
+        uniform_int_distribution<int> node(0, network.size() - 1);
+        uniform_real_distribution<double> phase(0.0, config.gpsInterval);
+        for (int c = 0; c < config.couriers; ++c) {
+            Point p = network.locationOf(node(rng));
+            network.updateCourierPosition(c, p.x, p.y);
+            schedule(phase(rng), COURIER_PING, c);
+        }
+        scheduleNextArrival(0.0);
+        schedule(config.dispatchInterval, DISPATCH_TICK);
+        if (config.routeChangeRate > 0)
+            schedule(exponential_distribution<double>(config.routeChangeRate)(rng), ROUTE_CHANGE);
+
+        auto start = chrono::steady_clock::now();
+        while (!queue.empty()) {
+            Event e = queue.pop();
+            handle(e, report);
+            report.events++;
+        }
+        report.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        for (size_t id = 0; id < arrivalTime.size(); ++id)
+            if (!dispatched[id]) report.backlogAges.push_back(config.duration - arrivalTime[id]);
+        return report;
+    }
+};
+
+// ----------- Synthetic City -----------
+/**
+ * side x side grid road network with `spacing` metres between intersections
+ * Every intersection is a located node; costs are random travel seconds per block
+ */
+DeliveryNetwork buildGridCity(int side, double spacing, unsigned seed) {
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> roadCost(30, 180);
+    DeliveryNetwork dn(side * side);
+    for (int r = 0; r < side; ++r)
+        for (int c = 0; c < side; ++c) {
+            dn.setLocation(r * side + c, c * spacing, r * spacing);
+            if (c + 1 < side) dn.addRoute(r * side + c, r * side + c + 1, roadCost(rng));
+            if (r + 1 < side) dn.addRoute(r * side + c, (r + 1) * side + c, roadCost(rng));
+        }
+    return dn;
+}
+
+// ----------- Benchmark Suite -----------
+/**
+ * Reproducible benchmarks for the core DeliveryNetwork algorithms
+ *   ./delivery --bench [--scale small|medium|large] [--json out.json]
+ *                      [--baseline old.json] [--threshold percent]
+ * Graph generators (fixed seeds, so every run sees identical inputs):
+ * - grid road network: side x side intersections, 4-neighbour streets
+ * - random geometric graph: uniform points joined to all points within a
+ *   radius chosen for an average degree of ~8 (k-d tree radius queries)
+ * - power-law graph: Barabasi-Albert preferential attachment, 3 links per node
+ * Each benchmark runs several repetitions and reports the median and
+ * minimum nanoseconds per operation. With --baseline, medians are compared
+ * against an earlier JSON report and the exit code is 1 if any benchmark
+ * got slower than the threshold (default 10%); an unknown scale exits with 2
+ */
+struct BenchmarkResult {
+    string name;
+    long long operations;   // Work units per repetition (edges, heap ops, ...)
+    double medianNsPerOp;
+    double minNsPerOp;
+};
+
+// side x side grid of streets with random block costs
+vector<Edge> generateGridRoads(int nodes, unsigned seed) {
+    int side = max(2, (int)sqrt((double)nodes));
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> cost(30, 180);
+    vector<Edge> edges;
+    for (int r = 0; r < side; ++r)
+        for (int c = 0; c < side; ++c) {
+            if (c + 1 < side) edges.push_back(Edge(r * side + c, r * side + c + 1, cost(rng)));
+            if (r + 1 < side) edges.push_back(Edge(r * side + c, (r + 1) * side + c, cost(rng)));
+        }
+    return edges;
+}
+
+// Points in the unit square joined when closer than r (cost = rounded distance)
+vector<Edge> generateGeometricGraph(int nodes, unsigned seed) {
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> coord(0.0, 1.0);
+    vector<pair<int, Point>> points(nodes);
+    for (int i = 0; i < nodes; ++i) points[i] = {i, {coord(rng), coord(rng)}};
+    KDTree tree;
+    tree.build(points);
+    double radius = sqrt(8.0 / (acos(-1.0) * nodes));  // Expected degree ~8
+    vector<Edge> edges;
+    for (int i = 0; i < nodes; ++i)
+        for (int j : tree.radiusQuery(points[i].second, radius))
+            if (i < j) {
+                double d = sqrt(squaredDistance(points[i].second, points[j].second));
+                edges.push_back(Edge(i, j, 1 + (int)(d / radius * 1000)));
+            }
+    return edges;
+}
+
+// Barabasi-Albert: each new node links to `links` existing nodes chosen with
+// probability proportional to their degree (sampling from the endpoint list)
+vector<Edge> generatePowerLawGraph(int nodes, unsigned seed, int links = 3) {
+    mt19937_64 rng(seed);
+    uniform_int_distribution<int> cost(1, 1000);
+    vector<Edge> edges;
+    vector<int> endpoints;  // Every edge endpoint once: degree-proportional sampling
+    for (int u = 1; u <= links && u < nodes; ++u) {
+        edges.push_back(Edge(0, u, cost(rng)));
+        endpoints.push_back(0);
+        endpoints.push_back(u);
+    }
+    for (int u = links + 1; u < nodes; ++u) {
+        for (int k = 0; k < links; ++k) {
+            int v = endpoints[uniform_int_distribution<size_t>(0, endpoints.size() - 1)(rng)];
+            edges.push_back(Edge(u, v, cost(rng)));
+            endpoints.push_back(u);
+            endpoints.push_back(v);
+        }
+    }
+    return edges;
+}
+
+// Time `run` over `repetitions` runs, calling the untimed `prepare` before each
+BenchmarkResult measure(const string& name, long long operations, int repetitions,
+                        const function<void()>& prepare, const function<void()>& run) {
+    vector<double> nsPerOp;
+    for (int r = 0; r < repetitions; ++r) {
+        prepare();
+        auto start = chrono::steady_clock::now();
+        run();
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        nsPerOp.push_back(ns / max(1LL, operations));
+    }
+    sort(nsPerOp.begin(), nsPerOp.end());
+    return {name, operations, nsPerOp[nsPerOp.size() / 2], nsPerOp[0]};
+}
+
+string benchmarkJson(const string& scale, const vector<BenchmarkResult>& results) {
+    ostringstream out;
+    out << "{\n  \"suite\": \"delivery\",\n  \"scale\": \"" << scale << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"operations\": " << r.operations
+            << ", \"median_ns_per_op\": " << r.medianNsPerOp
+            << ", \"min_ns_per_op\": " << r.minNsPerOp << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+// Read name -> median_ns_per_op from a report written by benchmarkJson
+map<string, double> readBenchmarkBaseline(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("cannot read baseline " + path);
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    map<string, double> medians;
+    const string nameKey = "\"name\": \"", medianKey = "\"median_ns_per_op\": ";
+    for (size_t at = text.find(nameKey); at != string::npos; at = text.find(nameKey, at)) {
+        at += nameKey.size();
+        string name = text.substr(at, text.find('"', at) - at);
+        size_t value = text.find(medianKey, at);
+        if (value == string::npos) break;
+        medians[name] = atof(text.c_str() + value + medianKey.size());
+    }
+    return medians;
+}
+
+int runBenchmarkSuite(int argc, char** argv) {
+    string scale = "small", jsonPath, baselinePath;
+    double threshold = 10.0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--scale") scale = argv[i + 1];
+        else if (flag == "--json") jsonPath = argv[i + 1];
+        else if (flag == "--baseline") baselinePath = argv[i + 1];
+        else if (flag == "--threshold") threshold = atof(argv[i + 1]);
+    }
+    if (scale != "small" && scale != "medium" && scale != "large") {
+        cerr << "unknown --scale " << scale << " (expected small, medium or large)\n";
+        return 2;
+    }
+    int nodes = scale == "large" ? 1000000 : scale == "medium" ? 100000 : 10000;
+    int repetitions = scale == "large" ? 3 : 5;
+    vector<BenchmarkResult> results;
+
+    // Kruskal MST on each generator; a fresh network per repetition keeps the sort honest
+    vector<pair<string, vector<Edge>>> graphs = {
+        {"grid", generateGridRoads(nodes, 1)},
+        {"geometric", generateGeometricGraph(nodes, 2)},
+        {"powerlaw", generatePowerLawGraph(nodes, 3)},
+    };
+    for (const auto& [graphName, edges] : graphs) {
+        unique_ptr<DeliveryNetwork> dn;
+        results.push_back(measure("mst/" + graphName, edges.size(), repetitions,
+            [&, &edges = edges] {
+                dn.reset(new DeliveryNetwork(nodes));
+                for (const Edge& e : edges) dn->addRoute(e.u, e.v, e.weight);
+            },
+            [&] { dn->computeMinimumCostNetwork(); }));
+    }
+
+    // MaxHeap: n random inserts, then n extractions
+    mt19937_64 rng(4);
+    vector<int> priorities(nodes * 10);
+    for (int& p : priorities) p = uniform_int_distribution<int>(0, 1 << 30)(rng);
+    MaxHeap heap;
+    results.push_back(measure("heap/insert", priorities.size(), repetitions,
+        [&] { heap = MaxHeap(); },
+        [&] { for (size_t i = 0; i < priorities.size(); ++i) heap.insert(Order(i, priorities[i])); }));
+    results.push_back(measure("heap/extract", priorities.size(), repetitions,
+        [&] { heap = MaxHeap(); for (size_t i = 0; i < priorities.size(); ++i) heap.insert(Order(i, priorities[i])); },
+        [&] { Order o; while (heap.tryExtractMax(o)) {} }));
+
+    // DisjointSet: random unions followed by random finds
+    vector<pair<int, int>> pairs(nodes * 10);
+    for (auto& [a, b] : pairs) {
+        a = uniform_int_distribution<int>(0, nodes - 1)(rng);
+        b = uniform_int_distribution<int>(0, nodes - 1)(rng);
+    }
+    unique_ptr<DisjointSet> ds;
+    long long sink = 0;
+    results.push_back(measure("disjoint_set/unite", pairs.size(), repetitions,
+        [&] { ds.reset(new DisjointSet(nodes)); },
+        [&] { for (auto& [a, b] : pairs) ds->unite(a, b); }));
+    // Fresh sets per repetition, so finds never start from paths an earlier
+    // repetition already compressed
+    results.push_back(measure("disjoint_set/find", pairs.size(), repetitions,
+        [&] {
+            ds.reset(new DisjointSet(nodes));
+            for (auto& [a, b] : pairs) ds->unite(a, b);
+        },
+        [&] { for (auto& [a, b] : pairs) sink += ds->find(a) == ds->find(b); }));
+
+    // recommendMenus: KMP keyword search over generated menu names
+    const vector<string> words = {"Spicy", "Chicken", "Rice", "Sweet", "Sour", "Pork", "Grilled",
+                                  "Beef", "Noodle", "Soup", "Vegetarian", "Salad", "Wrap", "Curry"};
+    DeliveryNetwork menus(1);
+    int menuCount = nodes;
+    for (int i = 0; i < menuCount; ++i) {
+        string item;
+        for (int w = 0; w < 4; ++w) item += (w ? " " : "") + words[uniform_int_distribution<size_t>(0, words.size() - 1)(rng)];
+        menus.addMenuItem(item);
+    }
+    results.push_back(measure("menus/recommend", menuCount, repetitions, [] {},
+        [&] { sink += menus.findMenus("Chicken Rice").size(); }));
+
+    cout << "Benchmark suite (scale " << scale << ", " << nodes << " nodes, median of "
+         << repetitions << " runs)\n";
+    for (const auto& r : results)
+        cout << "  " << r.name << string(max(1, 22 - (int)r.name.size()), ' ') << r.medianNsPerOp
+             << " ns/op (min " << r.minNsPerOp << ", " << r.operations << " ops)\n";
+    cout << "  (checksum " << sink << ")\n";  // Keeps the measured work observable
+
+    if (!jsonPath.empty()) {
+        ofstream(jsonPath) << benchmarkJson(scale, results);
+        cout << "Wrote " << jsonPath << "\n";
+    }
+    int regressions = 0;
+    if (!baselinePath.empty()) {
+        map<string, double> baseline = readBenchmarkBaseline(baselinePath);
+        cout << "Comparison with " << baselinePath << " (threshold " << threshold << "%):\n";
+        for (const auto& r : results) {
+            auto it = baseline.find(r.name);
+            if (it == baseline.end() || it->second <= 0) {
+                cout << "  " << r.name << ": no baseline\n";
+                continue;
+            }
+            double change = (r.medianNsPerOp - it->second) / it->second * 100.0;
+            bool regressed = change > threshold;
+            regressions += regressed;
+            cout << "  " << r.name << string(max(1, 22 - (int)r.name.size()), ' ') << showpos << change
+                 << noshowpos << "%" << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+// ----------- Spatial Index Benchmark -----------
+/**
+ * Times k-d tree bulk load, kNN and radius queries, and courier grid updates
+ * on n uniformly random points (run with: ./delivery --bench-spatial [n])
+ */
+void runSpatialBenchmark(int n) {
+    using Clock = chrono::steady_clock;
+    auto elapsedMs = [](Clock::time_point start) {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    };
+    const double side = 100000.0;  // 100 km x 100 km city, coordinates in metres
+    const int queries = 100000;
+    mt19937_64 rng(42);
+    uniform_real_distribution<double> coord(0.0, side);
+
+    vector<pair<int, Point>> points(n);
+    for (int i = 0; i < n; ++i) points[i] = {i, {coord(rng), coord(rng)}};
+    vector<Point> probes(queries);
+    for (auto& q : probes) q = {coord(rng), coord(rng)};
+
+    cout << "Spatial index benchmark: " << n << " points, " << queries << " queries\n";
+
+    KDTree tree;
+    auto start = Clock::now();
+    tree.build(points);
+    cout << "k-d tree bulk load:      " << elapsedMs(start) << " ms\n";
+
+    long checksum = 0;
+    start = Clock::now();
+    for (const Point& q : probes) checksum += tree.nearest(q, 8)[0];
+    cout << "k-d tree 8-NN query:     " << elapsedMs(start) * 1e6 / queries << " ns/query\n";
+
+    start = Clock::now();
+    for (const Point& q : probes) checksum += tree.radiusQuery(q, 250.0).size();
+    cout << "k-d tree radius query:   " << elapsedMs(start) * 1e6 / queries << " ns/query\n";
+
+    // Couriers: ~4 per cell on average keeps ring searches short
+    double cellSize = side / sqrt(n / 4.0);
+    UniformGrid grid(0, 0, side, side, cellSize);
+    start = Clock::now();
+    for (const auto& [id, p] : points) grid.update(id, p);
+    cout << "grid insert:             " << elapsedMs(start) * 1e6 / n << " ns/update\n";
+
+    // Small random moves, as produced by GPS pings every few seconds
+    normal_distribution<double> jitter(0.0, 30.0);
+    start = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        Point p = grid.positionOf(i);
+        grid.update(i, {p.x + jitter(rng), p.y + jitter(rng)});
+    }
+    cout << "grid position update:    " << elapsedMs(start) * 1e6 / n << " ns/update\n";
+
+    start = Clock::now();
+    for (const Point& q : probes) checksum += grid.nearest(q, 8)[0];
+    cout << "grid 8-NN query:         " << elapsedMs(start) * 1e6 / queries << " ns/query\n";
+
+    // Spot-check both indexes against brute force
+    for (int i = 0; i < 10; ++i) {
+        const Point& q = probes[i];
+        int bruteTree = 0, bruteGrid = 0;
+        for (int j = 1; j < n; ++j) {
+            if (squaredDistance(points[j].second, q) < squaredDistance(points[bruteTree].second, q)) bruteTree = j;
+            if (squaredDistance(grid.positionOf(j), q) < squaredDistance(grid.positionOf(bruteGrid), q)) bruteGrid = j;
+        }
+        if (tree.nearest(q, 1)[0] != bruteTree || grid.nearest(q, 1)[0] != bruteGrid)
+            cout << "MISMATCH against brute force at probe " << i << "\n";
+    }
+    cout << "(checksum " << checksum << ")\n";
+}
+
+// ----------- Dispatch Benchmark -----------
+/**
+ * Plans routes for `orders` random orders on a side x side grid road network
+ * (run with: ./delivery --bench-dispatch [orders])
+ */
+void runDispatchBenchmark(int orders) {
+    const int side = 40;
+    mt19937_64 rng(7);
+    uniform_int_distribution<int> node(0, side * side - 1), priority(1, 10);
+    DeliveryNetwork dn = buildGridCity(side, 150.0, 7);
+    for (int i = 0; i < orders; ++i) dn.addOrder(i, priority(rng), node(rng));
+
+    auto start = chrono::steady_clock::now();
+    DispatchPlan plan = dn.planDispatch(side * side / 2 + side / 2, 15, 600);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    size_t carried = 0;
+    for (const auto& route : plan.routes) carried += route.orderIds.size();
+    cout << "Dispatch benchmark: " << orders << " orders on a " << side << "x" << side << " grid\n";
+    cout << "Planning time:         " << ms << " ms\n";
+    cout << "Routes:                " << plan.routes.size() << " (" << carried << " orders)\n";
+    cout << "Cost after savings:    " << plan.initialCost << "\n";
+    cout << "Cost after local search: " << plan.totalCost << "\n";
+}
+
+// ----------- Journal Benchmark -----------
+/**
+ * Records orders at a paced 50k orders/s through an attached journal and
+ * reports per-order recording latency, then reopens the journal and times
+ * recovery (run with: ./delivery --bench-journal [path])
+ */
+void runJournalBenchmark(const string& path) {
+    using Clock = chrono::steady_clock;
+    const int orders = 200000;
+    const double ratePerSecond = 50000.0;
+    ::remove(path.c_str());
+
+    vector<double> latencyNs;
+    latencyNs.reserve(orders);
+    {
+        OrderJournal journal(path);
+        DeliveryNetwork dn(1);
+        dn.attachJournal(journal);
+        auto start = Clock::now();
+        for (int i = 0; i < orders; ++i) {
+            // Pace arrivals: wait for this order's slot
+            auto due = start + chrono::nanoseconds((long long)(i * 1e9 / ratePerSecond));
+            while (Clock::now() < due) {}
+            auto before = Clock::now();
+            dn.addOrder(i, i % 100, 0);
+            latencyNs.push_back(chrono::duration<double, nano>(Clock::now() - before).count());
+        }
+        // Dispatch a quarter of them so recovery has extractions to apply
+        vector<Order> processed;
+        dn.processOrders(orders / 4, processed);
+        journal.sync();
+    }
+    sort(latencyNs.begin(), latencyNs.end());
+    cout << "Journal benchmark: " << orders << " orders at " << (int)ratePerSecond << " orders/s\n";
+    cout << "addOrder latency:  p50=" << latencyNs[orders / 2] << " ns  p99="
+         << latencyNs[orders * 99 / 100] << " ns  max=" << latencyNs.back() << " ns\n";
+
+    auto start = Clock::now();
+    OrderJournal journal(path);
+    DeliveryNetwork dn(1);
+    dn.attachJournal(journal);
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    vector<Order> first;
+    dn.processOrders(1, first);
+    cout << "Recovery:          " << journal.recoveredOrders().size() << " orders in " << ms
+         << " ms (most urgent recovered priority " << (first.empty() ? -1 : first[0].priority) << ")\n";
+    ::remove(path.c_str());
+}
+
+// ----------- Compressed Graph Benchmark -----------
+/**
+ * Builds a side x side grid road network with shuffled node ids, then
+ * compares plain CSR with compressed CSR (original and RCM order): memory,
+ * Dijkstra and Prim running through the shared neighbor-cursor interface,
+ * and a save / mmap round trip (run with: ./delivery --bench-compressed [side])
+ */
+void runCompressedGraphBenchmark(int side) {
+    using Clock = chrono::steady_clock;
+    auto elapsedMs = [](Clock::time_point start) {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    };
+    int n = side * side;
+    mt19937_64 rng(11);
+    vector<int> label(n);  // Shuffled ids destroy the natural row-major locality
+    for (int i = 0; i < n; ++i) label[i] = i;
+    shuffle(label.begin(), label.end(), rng);
+    uniform_int_distribution<int> roadCost(30, 180);
+    vector<Edge> edges;
+    for (int r = 0; r < side; ++r)
+        for (int c = 0; c < side; ++c) {
+            if (c + 1 < side) edges.push_back(Edge(label[r * side + c], label[r * side + c + 1], roadCost(rng)));
+            if (r + 1 < side) edges.push_back(Edge(label[r * side + c], label[(r + 1) * side + c], roadCost(rng)));
+        }
+    RouteGraph plain;
+    plain.build(n, edges);
+    int source = label[(side / 2) * side + side / 2];
+
+    cout << "Compressed graph benchmark: " << n << " nodes, " << 2 * edges.size() << " arcs\n";
+    vector<long long> reference;
+    auto start = Clock::now();
+    plain.shortestPaths(source, reference);
+    double plainDijkstra = elapsedMs(start);
+    start = Clock::now();
+    long long plainMst = primMinimumSpanningCost(plain);
+    double plainPrim = elapsedMs(start);
+    cout << "plain CSR:       " << plain.memoryBytes() / 1048576.0 << " MiB, Dijkstra "
+         << plainDijkstra << " ms, Prim " << plainPrim << " ms\n";
+
+    for (NodeOrder order : {NodeOrder::ORIGINAL, NodeOrder::RCM}) {
+        CompressedRouteGraph compressed;
+        start = Clock::now();
+        compressed.build(plain, order);
+        double buildMs = elapsedMs(start);
+        vector<long long> dist;
+        start = Clock::now();
+        dijkstraShortestPaths(compressed, compressed.internalId(source), dist);
+        double dijkstraMs = elapsedMs(start);
+        start = Clock::now();
+        long long mst = primMinimumSpanningCost(compressed);
+        double primMs = elapsedMs(start);
+        bool same = mst == plainMst;
+        for (int v = 0; v < n && same; ++v) same = dist[compressed.internalId(v)] == reference[v];
+        cout << (order == NodeOrder::RCM ? "compressed RCM:  " : "compressed orig: ")
+             << compressed.memoryBytes() / 1048576.0 << " MiB (build " << buildMs << " ms), Dijkstra "
+             << dijkstraMs << " ms, Prim " << primMs << " ms" << (same ? "" : "  MISMATCH") << "\n";
+
+        if (order == NodeOrder::RCM) {
+            const string path = "delivery_bench.csr";
+            compressed.save(path);
+            start = Clock::now();
+            CompressedRouteGraph mapped = CompressedRouteGraph::openMapped(path);
+            double openMs = elapsedMs(start);
+            dijkstraShortestPaths(mapped, mapped.internalId(source), dist);
+            bool mappedSame = dist[mapped.internalId(label[0])] == reference[label[0]];
+            cout << "mmap reopen:     " << openMs << " ms" << (mappedSame ? "" : "  MISMATCH") << "\n";
+            ::remove(path.c_str());
+        }
+    }
+}
+
+// ----------- Main Driver -----------
+/**
+ * Demonstration of the complete food delivery and logistics system
+ * Shows integration of MST, Priority Queue, and String Matching algorithms
+ */
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") return runBenchmarkSuite(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--bench-spatial") {
+        runSpatialBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--simulate") {
+        // ./delivery --simulate [ordersPerSecond] [simulatedSeconds] [traceFile]
+        SimulationConfig config;
+        if (argc > 2) config.arrivalRate = atof(argv[2]);
+        if (argc > 3) config.duration = atof(argv[3]);
+        if (argc > 4) config.tracePath = argv[4];
+        DeliveryNetwork city = buildGridCity(40, 150.0, config.seed);
+        config.depot = 40 * 20 + 20;  // City centre
+        DeliverySimulator simulator(city, config);
+        simulator.run().print();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-compressed") {
+        runCompressedGraphBenchmark(argc > 2 ? atoi(argv[2]) : 1000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-journal") {
+        runJournalBenchmark(argc > 2 ? argv[2] : "delivery_bench.journal");
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-dispatch") {
+        runDispatchBenchmark(argc > 2 ? atoi(argv[2]) : 10000);
+        return 0;
+    }
+
+    // Initialize delivery network with 6 locations (nodes 0-5)
+    DeliveryNetwork dn(6);
+
+    // Add delivery routes between locations
+    // Format: addRoute(source, destination, cost, hasPromo)
+    dn.addRoute(0, 1, 4);
+    dn.addRoute(0, 2, 4);
+    dn.addRoute(1, 2, 2, true);  // Promotional route with discount
+    dn.addRoute(1, 3, 5);
+    dn.addRoute(2, 3, 8);
+    dn.addRoute(2, 4, 10);
+    dn.addRoute(3, 4, 2);
+    dn.addRoute(3, 5, 6, true); // Promotional route with discount
+    dn.addRoute(4, 5, 3);
+
+    // Add orders with different priorities for demonstration
+    // Format: addOrder(orderID, priority)
+    dn.addOrder(101, 2);  // Low priority
+    dn.addOrder(102, 5);  // High priority (processed first)
+    dn.addOrder(103, 3);  // Medium priority
+
+    // Add menu items for recommendation system
+    dn.addMenuItem("Spicy Chicken Rice");
+    dn.addMenuItem("Sweet and Sour Pork");
+    dn.addMenuItem("Vegetarian Salad");
+    dn.addMenuItem("Grilled Chicken Wrap");
+
+    // Place the locations on the map (coordinates in metres)
+    dn.setLocation(0, 0, 0);
+    dn.setLocation(1, 400, 300);
+    dn.setLocation(2, 900, 100);
+    dn.setLocation(3, 600, 800);
+    dn.setLocation(4, 1200, 900);
+    dn.setLocation(5, 1500, 400);
+    dn.addRestaurant(1);
+    dn.addRestaurant(4);
+
+    // Couriers report GPS positions; later pings simply move them
+    dn.updateCourierPosition(7, 100, 50);
+    dn.updateCourierPosition(8, 1400, 500);
+    dn.updateCourierPosition(9, 700, 700);
+    dn.updateCourierPosition(7, 1000, 150);  // Courier 7 has moved east
+
+    // Execute system operations
+    dn.processOrders();           // Process orders by priority using max heap
+    dn.recommendMenus("Chicken"); // Find menu items containing "Chicken" using KMP
+    
+    // Build minimum cost network using Kruskal's MST algorithm
+    int minCost = dn.buildMinimumCostNetwork();
+    cout << "\nTotal Minimum Cost to Build Network: " << minCost << "\n";
+
+    // Rush hour (7:00-9:59 and 17:00-19:59) doubles the cost of the 0-1 and 3-4 routes
+    vector<int> rushHour(24);
+    for (int hour = 0; hour < 24; ++hour)
+        rushHour[hour] = (hour >= 7 && hour < 10) || (hour >= 17 && hour < 20) ? 2 : 1;
+    vector<int> route01(24), route34(24);
+    for (int hour = 0; hour < 24; ++hour) {
+        route01[hour] = 4 * rushHour[hour];
+        route34[hour] = 2 * rushHour[hour];
+    }
+    dn.setRouteProfile(0, 1, route01);
+    dn.setRouteProfile(3, 4, route34);
+    int nightCost = dn.buildMinimumCostNetwork(3);
+    cout << "Night (3:00) network cost: " << nightCost << "\n";
+    int rushCost = dn.buildMinimumCostNetwork(8);
+    cout << "Rush hour (8:00) network cost: " << rushCost << "\n";
+    cout << "Travel time 0 -> 4 departing 3:00: " << dn.travelTimeAt(0, 4, 3 * 60)
+         << ", departing 8:00: " << dn.travelTimeAt(0, 4, 8 * 60) << "\n";
+
+    // Spatial queries: nearest restaurant to a customer, nearest couriers to a pickup
+    cout << "\nNearest restaurant to customer at (1300, 600): Node "
+         << dn.nearestRestaurants(1300, 600, 1)[0] << "\n";
+    cout << "Closest couriers to pickup at Node 2:";
+    for (int courier : dn.nearestCouriers(2, 2)) cout << " Courier " << courier;
+    cout << "\nLocations within 500 of (500, 500):";
+    for (int node : dn.locationsWithinRadius(500, 500, 500)) cout << " " << node;
+    cout << "\n";
+
+    // Batch new orders (with delivery nodes) into courier routes from the hub at node 0
+    dn.addOrder(201, 4, 3);
+    dn.addOrder(202, 2, 5);
+    dn.addOrder(203, 5, 4);
+    dn.addOrder(204, 1, 2);
+    dn.addOrder(205, 3, 5);
+    DispatchPlan plan = dn.planDispatch(0, 3);
+    cout << "\nDispatch Plan (capacity 3 orders per courier):\n";
+    for (const CourierRoute& route : plan.routes) {
+        cout << "Courier " << route.courier << " | Stops:";
+        for (int stop : route.stops) cout << " " << stop;
+        cout << " | Orders:";
+        for (int id : route.orderIds) cout << " " << id;
+        cout << " | Cost: " << route.cost << "\n";
+    }
+    cout << "Total Dispatch Cost: " << plan.totalCost << "\n";
+
+    // Overlap intake and dispatch: 4 intake threads publish into a lock-free
+    // ring while the dispatcher thread drains it into the heap in batches
+    long long dispatchedCount = 0, prioritySum = 0;
+    OrderPipeline pipeline(dn, 1024, 64, [&](const Order& o) {
+        dispatchedCount++;
+        prioritySum += o.priority;
+    });
+    pipeline.start();
+    vector<thread> intakeThreads;
+    for (int t = 0; t < 4; ++t) {
+        intakeThreads.emplace_back([&pipeline, t]() {
+            for (int i = 0; i < 1000; ++i) {
+                Order o(1000 * (t + 1) + i, i % 10);
+                while (!pipeline.submit(o)) this_thread::yield();  // Retry when the ring is full
+            }
+        });
+    }
+    for (thread& t : intakeThreads) t.join();
+    pipeline.stop();
+    cout << "\nConcurrent intake: " << dispatchedCount << " orders dispatched"
+         << " (priority sum " << prioritySum << ")\n";
+
+    // Zone-sharded dispatch: one heap and one dispatcher thread per zone
+    unique_ptr<ZoneDispatcher> zones = dn.makeZoneDispatcher(2);
+    for (int i = 0; i < 12; ++i) dn.addOrder(300 + i, (i * 7) % 10, i % 6);
+    dn.shardPendingOrders(*zones);
+    int urgentPriority;
+    int urgentZone = zones->mostUrgentZone(urgentPriority);
+    cout << "\nMost urgent order across zones: priority " << urgentPriority << " in zone " << urgentZone << "\n";
+    atomic<int> zoneDispatched{0};
+    dn.startZoneDispatch(*zones, [&](int, const Order&) { zoneDispatched++; });
+    zones->finish();
+    cout << "Zone dispatchers handled " << zoneDispatched << " orders\n";
 
     return 0;
 }
@@ -2,7 +2,7 @@
  * Hospital Management System - Class-Based Implementation
  * This file implements a comprehensive hospital management system using object-oriented design:
  * - HospitalStructure class: Tree-based organizational hierarchy management
- * - PatientRecordSystem class: Balanced BST for patient data storage
+ * - PatientRecordSystem class: Sharded concurrent hash table for patient data storage
  * - ReferralSystem class: Graph-based doctor referral network with pathfinding
  * - TreatmentPlanner class: DFS-based treatment combination analysis
  */
@@ -15,6 +15,44 @@
 #include <limits>
 #include <set>
 #include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <memory>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <string_view>
+#include <stdexcept>
+#include <sstream>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cmath>
+#include <cctype>
+#include <type_traits>
+#include <array>
+#include <iterator>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+// Lazy combination generators need C++20 coroutines (compile with -std=c++20)
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>) && __has_include(<span>)
+#include <coroutine>
+#include <iterator>
+#include <span>
+#include <utility>
+#define HOSPITAL_HAS_COROUTINES 1
+#endif
 
 using namespace std;
 
@@ -68,115 +106,3561 @@ public:
 };
 
 // ============================
-// Class: PatientRecordSystem (Balanced BST using std::map)
+// Helper: writeFully (Positioned File Writes)
 // ============================
 
-// Manages patient records using a balanced binary search tree for efficient operations
-// Provides O(log n) search, insert, and delete operations
+// Writes all bytes at offset `at`, retrying short writes; throws on failure
+void writeFully(int fd, const void* data, size_t bytes, off_t at, const string& path) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = pwrite(fd, p, bytes, at);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw runtime_error("cannot write " + path);
+        p += n;
+        bytes -= n;
+        at += n;
+    }
+}
+
+// ============================
+// Interface: RecordStore (Storage Backend)
+// ============================
+
+// Storage engine behind PatientRecordSystem: a keyed string store
+// Implementations must allow concurrent get() calls
+class RecordStore {
+public:
+    virtual ~RecordStore() = default;
+
+    // Inserts or replaces the record stored under id
+    virtual void put(const string& id, const string& record) = 0;
+
+    // Copies the record stored under id into record; false if absent
+    virtual bool get(const string& id, string& record) const = 0;
+
+    // Number of records stored
+    virtual size_t size() const = 0;
+
+    // Visits every stored (id, record) pair once, in no particular order
+    virtual void scan(const function<void(const string& id, const string& record)>& visit) const = 0;
+
+    // Makes every put() so far durable (no-op for in-memory stores)
+    virtual void flush() {}
+};
+
+// ============================
+// Class: ShardedRecordStore (Concurrent Hash Table)
+// ============================
+
+// Thread-safe string -> string store for patient records
+// Keys are hashed once; the top bits pick one of a power-of-two number of
+// shards and the low bits a slot in that shard's open-addressing table
+// (linear probing). Each shard has its own reader/writer lock, so readers
+// on any shard proceed together and a writer only blocks its own shard.
+// Values are immutable and reference-counted: a lookup hands out a handle
+// to the stored string instead of copying it, and the handle stays valid
+// even if the record is replaced afterwards
+// Multi-version reads: every put() gets a commit timestamp from a global
+// clock, taken while the shard lock is held, so a snapshot at time t sees
+// exactly the puts stamped <= t. While snapshots are pinned, a replaced
+// value moves onto the slot's chain of older versions; a background
+// collector drops versions no pinned snapshot can see. With no snapshot
+// pinned, puts keep no history at all
+class ShardedRecordStore : public RecordStore {
+public:
+    using Handle = shared_ptr<const string>;
+
+private:
+    // Older value of a record, newest first along `older`
+    struct Version {
+        uint64_t commit;
+        Handle value;
+        shared_ptr<Version> older;
+    };
+
+    struct Slot {
+        uint64_t hash = 0;
+        string id;
+        Handle value;  // Null: slot unused
+        uint64_t commit = 0;  // Timestamp of value
+        shared_ptr<Version> older;
+    };
+
+    // One cache line at least per shard so neighbouring locks do not false-share
+    struct alignas(64) Shard {
+        mutable shared_mutex lock;
+        vector<Slot> slots;  // Capacity is a power of two
+        size_t used = 0;
+    };
+
+    vector<Shard> shards;
+    int shardBits;
+
+    // Commit clock and pinned snapshot timestamps
+    atomic<uint64_t> clock{0};
+    atomic<int> pinnedCount{0};
+    atomic<bool> historyKept{false};  // Some slot may have older versions
+    mutex pinLock;
+    multiset<uint64_t> pinned;
+
+    // Background version collector, started by the first snapshot
+    once_flag collectorStarted;
+    thread collector;
+    condition_variable collectorWake;
+    bool stopping = false;
+
+    static uint64_t hashId(const string& id) {
+        // std::hash then a 64-bit finalizer (splitmix64) so both ends of the hash are well mixed
+        uint64_t h = hash<string>()(id);
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+    Shard& shardFor(uint64_t h) { return shards[shardBits ? h >> (64 - shardBits) : 0]; }
+    const Shard& shardFor(uint64_t h) const { return shards[shardBits ? h >> (64 - shardBits) : 0]; }
+
+    // Slot holding id, or the empty slot where it would go
+    static size_t probe(const vector<Slot>& slots, uint64_t h, const string& id) {
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask)
+            if (!slots[i].value || (slots[i].hash == h && slots[i].id == id)) return i;
+    }
+
+    // Value of a slot as of timestamp ts (null if the record did not exist yet)
+    static Handle valueAt(const Slot& slot, uint64_t ts) {
+        if (slot.commit <= ts) return slot.value;
+        for (const Version* v = slot.older.get(); v; v = v->older.get())
+            if (v->commit <= ts) return v->value;
+        return nullptr;
+    }
+
+    void unpin(uint64_t ts) {
+        lock_guard<mutex> guard(pinLock);
+        pinned.erase(pinned.find(ts));
+        pinnedCount--;
+        collectorWake.notify_one();
+    }
+
+    void collectorLoop() {
+        unique_lock<mutex> guard(pinLock);
+        while (!stopping) {
+            collectorWake.wait_for(guard, chrono::milliseconds(100));
+            if (stopping) return;
+            guard.unlock();
+            collectGarbage();
+            guard.lock();
+        }
+    }
+
+    // Doubles a shard's table (caller holds its lock exclusively)
+    static void grow(Shard& shard) {
+        vector<Slot> bigger(shard.slots.size() * 2);
+        for (Slot& slot : shard.slots)
+            if (slot.value) bigger[probe(bigger, slot.hash, slot.id)] = move(slot);
+        shard.slots.swap(bigger);
+    }
+
+public:
+    // shardCount is rounded up to a power of two
+    explicit ShardedRecordStore(int shardCount = 64) {
+        shardBits = 0;
+        while ((1 << shardBits) < shardCount) shardBits++;
+        shards = vector<Shard>(size_t(1) << shardBits);
+        for (Shard& shard : shards) shard.slots.resize(16);
+    }
+
+    ~ShardedRecordStore() override {
+        {
+            lock_guard<mutex> guard(pinLock);
+            stopping = true;
+        }
+        collectorWake.notify_all();
+        if (collector.joinable()) collector.join();
+    }
+
+    ShardedRecordStore(const ShardedRecordStore&) = delete;
+    ShardedRecordStore& operator=(const ShardedRecordStore&) = delete;
+
+    // Pinned point-in-time view of the store; versions it can see are kept
+    // until it is destroyed. Must not outlive the store
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept : store(other.store), ts(other.ts) { other.store = nullptr; }
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot& operator=(Snapshot&&) = delete;
+        ~Snapshot() {
+            if (store) store->unpin(ts);
+        }
+
+        uint64_t timestamp() const { return ts; }
+
+        // The record as of the snapshot, or null if it did not exist then
+        Handle get(const string& id) const {
+            uint64_t h = hashId(id);
+            const Shard& shard = store->shardFor(h);
+            shared_lock<shared_mutex> guard(shard.lock);
+            return valueAt(shard.slots[probe(shard.slots, h, id)], ts);
+        }
+
+        // Visits every record as of the snapshot, shard by shard; each shard
+        // is locked only while its handles are copied, so writers keep going
+        template <class Visit>
+        void forEach(Visit&& visit) const {
+            vector<pair<string, Handle>> batch;
+            for (const Shard& shard : store->shards) {
+                batch.clear();
+                {
+                    shared_lock<shared_mutex> guard(shard.lock);
+                    for (const Slot& slot : shard.slots)
+                        if (slot.value)
+                            if (Handle value = valueAt(slot, ts)) batch.emplace_back(slot.id, move(value));
+                }
+                for (const auto& [id, value] : batch) visit(id, *value);
+            }
+        }
+
+    private:
+        friend class ShardedRecordStore;
+        Snapshot(ShardedRecordStore* store, uint64_t ts) : store(store), ts(ts) {}
+
+        ShardedRecordStore* store;
+        uint64_t ts;
+    };
+
+    // Pins a snapshot at the latest commit
+    // Time complexity: O(log p) for p pinned snapshots
+    Snapshot snapshot() {
+        call_once(collectorStarted, [this] { collector = thread([this] { collectorLoop(); }); });
+        lock_guard<mutex> guard(pinLock);
+        pinnedCount++;  // Before reading the clock: a put that saw no pins has a stamp <= ts
+        uint64_t ts = clock.load();
+        pinned.insert(ts);
+        return Snapshot(this, ts);
+    }
+
+    // Drops versions that no pinned snapshot (nor a future one) can see
+    // Runs in the background; callable directly
+    void collectGarbage() {
+        if (!historyKept.load()) return;
+        uint64_t horizon;
+        {
+            lock_guard<mutex> guard(pinLock);
+            horizon = pinned.empty() ? clock.load() : *pinned.begin();
+            if (pinned.empty()) historyKept = false;  // Puts keep no history until the next pin
+        }
+        for (Shard& shard : shards) {
+            unique_lock<shared_mutex> guard(shard.lock);
+            for (Slot& slot : shard.slots) {
+                if (!slot.older) continue;
+                if (slot.commit <= horizon) {
+                    slot.older.reset();
+                    continue;
+                }
+                for (Version* v = slot.older.get(); v; v = v->older.get())
+                    if (v->commit <= horizon) {
+                        v->older.reset();  // v is the newest version the horizon sees
+                        break;
+                    }
+            }
+        }
+    }
+
+    // Latest commit timestamp
+    uint64_t commitTimestamp() const { return clock.load(); }
+
+    // Older versions currently kept for snapshots
+    size_t historyVersions() const {
+        size_t total = 0;
+        for (const Shard& shard : shards) {
+            shared_lock<shared_mutex> guard(shard.lock);
+            for (const Slot& slot : shard.slots)
+                for (const Version* v = slot.older.get(); v; v = v->older.get()) total++;
+        }
+        return total;
+    }
+
+    // Inserts or replaces a record; readers holding the old handle keep the old value
+    // Time complexity: O(1) expected
+    void put(const string& id, const string& record) override {
+        uint64_t h = hashId(id);
+        Handle value = make_shared<const string>(record);  // Allocate outside the lock
+        Shard& shard = shardFor(h);
+        unique_lock<shared_mutex> guard(shard.lock);
+        size_t i = probe(shard.slots, h, id);
+        if (!shard.slots[i].value) {
+            if ((shard.used + 1) * 10 > shard.slots.size() * 7) {  // Keep load factor under 0.7
+                grow(shard);
+                i = probe(shard.slots, h, id);
+            }
+            shard.slots[i].hash = h;
+            shard.slots[i].id = id;
+            shard.used++;
+        }
+        Slot& slot = shard.slots[i];
+        uint64_t commit = ++clock;
+        if (pinnedCount.load() > 0 && slot.value) {
+            slot.older = make_shared<Version>(Version{slot.commit, move(slot.value), move(slot.older)});
+            historyKept = true;
+        } else {
+            slot.older.reset();
+        }
+        slot.value = move(value);
+        slot.commit = commit;
+    }
+
+    // Handle to the stored record, or null if absent (no string copy)
+    // Time complexity: O(1) expected, under a shared lock
+    Handle get(const string& id) const {
+        uint64_t h = hashId(id);
+        const Shard& shard = shardFor(h);
+        shared_lock<shared_mutex> guard(shard.lock);
+        return shard.slots[probe(shard.slots, h, id)].value;
+    }
+
+    bool get(const string& id, string& record) const override {
+        Handle value = get(id);
+        if (value) record = *value;
+        return value != nullptr;
+    }
+
+    size_t size() const override {
+        size_t total = 0;
+        for (const Shard& shard : shards) {
+            shared_lock<shared_mutex> guard(shard.lock);
+            total += shard.used;
+        }
+        return total;
+    }
+
+    // Locks one shard at a time; records updated during the scan may be seen either way
+    void scan(const function<void(const string&, const string&)>& visit) const override {
+        for (const Shard& shard : shards) {
+            shared_lock<shared_mutex> guard(shard.lock);
+            for (const Slot& slot : shard.slots)
+                if (slot.value) visit(slot.id, *slot.value);
+        }
+    }
+};
+
+// ============================
+// Class: BPlusTreeStore (Disk-Backed B+ Tree)
+// ============================
+
+// Persistent record store: a B+ tree in a file of 4 KiB pages
+// - Pages 0 and 1 hold alternating meta records (root, page count, record
+//   count, generation, checksum); opening picks the newest valid one, so a
+//   crash mid-commit falls back to the previous tree
+// - Updates are copy-on-write: every page on the path to a changed leaf is
+//   written to a fresh page, and the tree only becomes visible when
+//   flush() writes the other meta page after the data pages are synced.
+//   Pages replaced in a commit are reused only after the next commit, when
+//   no valid meta page can reach them any more (the free list lives in
+//   memory; space freed before a restart is not reclaimed)
+// - Reads binary-search pages in place through a read-only mmap of the
+//   file; pages written since the last flush are served from memory
+// - Bulk load streams sorted input straight into packed leaves and builds
+//   the inner levels bottom-up
+// Leaf cells are key+value, inner cells are key+child page; one record's
+// key and value together may not exceed MAX_CELL bytes
+class BPlusTreeStore : public RecordStore {
+public:
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr size_t MAX_CELL = 1024;
+
+private:
+    static constexpr uint16_t LEAF = 1, INNER = 2;
+    static constexpr size_t HEADER = 8;  // type u16 | count u16 | leftmost child u32 (inner pages)
+    static constexpr uint64_t MAGIC = 0x3145455254424848ULL;
+
+    struct Meta {
+        uint64_t magic;
+        uint64_t generation;
+        uint64_t records;
+        uint32_t root;       // 0: empty tree
+        uint32_t pageCount;  // Pages in use, including the two meta pages
+        uint64_t checksum;   // FNV-1a over the fields above
+    };
+
+    // Decoded page, used on the write path
+    struct Node {
+        bool leaf = true;
+        uint32_t leftmost = 0;     // Inner: child for keys below keys[0]
+        vector<string> keys;
+        vector<string> values;     // Leaf: value of keys[i]
+        vector<uint32_t> children; // Inner: child for keys in [keys[i], keys[i + 1])
+    };
+
+    string path;
+    int fd = -1;
+    const uint8_t* mapping = nullptr;
+    size_t mappedBytes = 0;
+    int metaSlot = 0;        // Meta page holding the last commit
+    uint64_t generation = 0;
+
+    // Working tree state (committed by flush)
+    uint32_t root = 0;
+    uint32_t pageCount = 2;
+    uint64_t records = 0;
+    unordered_map<uint32_t, unique_ptr<uint8_t[]>> dirty;  // Pages written since the last commit
+    vector<uint32_t> freedNow, freedLast, reusable;
+
+    mutable shared_mutex lock;
+
+    static uint16_t read16(const uint8_t* p) { uint16_t v; memcpy(&v, p, 2); return v; }
+    static uint32_t read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+    static void write16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); }
+    static void write32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+
+    static uint64_t metaChecksum(const Meta& m) {
+        uint64_t h = 1469598103934665603ULL;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&m);
+        for (size_t i = 0; i < offsetof(Meta, checksum); ++i) h = (h ^ bytes[i]) * 1099511628211ULL;
+        return h;
+    }
+
+    const uint8_t* page(uint32_t id) const {
+        auto it = dirty.find(id);
+        return it != dirty.end() ? it->second.get() : mapping + (size_t)id * PAGE_SIZE;
+    }
+
+    // Cell i of a page: offset table after the header, cells packed from the end
+    static const uint8_t* cell(const uint8_t* p, int i) { return p + read16(p + HEADER + 2 * i); }
+    static string_view keyAt(const uint8_t* p, int i) {
+        const uint8_t* c = cell(p, i);
+        size_t skip = read16(p) == LEAF ? 4 : 6;
+        return string_view(reinterpret_cast<const char*>(c + skip), read16(c));
+    }
+
+    static size_t encodedSize(const Node& n) {
+        size_t size = HEADER;
+        for (size_t i = 0; i < n.keys.size(); ++i)
+            size += 2 + (n.leaf ? 4 + n.keys[i].size() + n.values[i].size() : 6 + n.keys[i].size());
+        return size;
+    }
+
+    static void encode(const Node& n, uint8_t* p) {
+        memset(p, 0, PAGE_SIZE);
+        write16(p, n.leaf ? LEAF : INNER);
+        write16(p + 2, n.keys.size());
+        write32(p + 4, n.leftmost);
+        size_t end = PAGE_SIZE;
+        for (size_t i = 0; i < n.keys.size(); ++i) {
+            const string& k = n.keys[i];
+            size_t size = n.leaf ? 4 + k.size() + n.values[i].size() : 6 + k.size();
+            end -= size;
+            write16(p + HEADER + 2 * i, end);
+            uint8_t* c = p + end;
+            write16(c, k.size());
+            if (n.leaf) {
+                write16(c + 2, n.values[i].size());
+                memcpy(c + 4, k.data(), k.size());
+                memcpy(c + 4 + k.size(), n.values[i].data(), n.values[i].size());
+            } else {
+                write32(c + 2, n.children[i]);
+                memcpy(c + 6, k.data(), k.size());
+            }
+        }
+    }
+
+    static Node decode(const uint8_t* p) {
+        Node n;
+        n.leaf = read16(p) == LEAF;
+        n.leftmost = read32(p + 4);
+        int count = read16(p + 2);
+        for (int i = 0; i < count; ++i) {
+            const uint8_t* c = cell(p, i);
+            n.keys.emplace_back(keyAt(p, i));
+            if (n.leaf) n.values.emplace_back(reinterpret_cast<const char*>(c + 4 + read16(c)), read16(c + 2));
+            else n.children.push_back(read32(c + 2));
+        }
+        return n;
+    }
+
+    uint32_t allocatePage() {
+        if (!reusable.empty()) {
+            uint32_t id = reusable.back();
+            reusable.pop_back();
+            return id;
+        }
+        return pageCount++;
+    }
+
+    // Writes n as the new version of page `old` (0: a new node) and returns
+    // its page id; pages already written in this commit are updated in place
+    uint32_t writeNode(const Node& n, uint32_t old) {
+        uint32_t id = old;
+        if (old == 0 || !dirty.count(old)) {
+            if (old != 0) freedNow.push_back(old);
+            id = allocatePage();
+            dirty[id].reset(new uint8_t[PAGE_SIZE]);
+        }
+        encode(n, dirty[id].get());
+        return id;
+    }
+
+    struct Split {
+        bool happened = false;
+        string key;       // First key of the right half
+        uint32_t right = 0;
+    };
+
+    // Splits an overfull node in two by bytes; n keeps the left half
+    static Node splitNode(Node& n, string& separator) {
+        Node right;
+        right.leaf = n.leaf;
+        size_t total = encodedSize(n), acc = HEADER, mid = 0;
+        while (mid + 1 < n.keys.size() && acc < total / 2) {
+            acc += 2 + (n.leaf ? 4 + n.keys[mid].size() + n.values[mid].size() : 6 + n.keys[mid].size());
+            mid++;
+        }
+        mid = max<size_t>(mid, 1);
+        separator = n.keys[mid];
+        if (n.leaf) {
+            right.keys.assign(n.keys.begin() + mid, n.keys.end());
+            right.values.assign(n.values.begin() + mid, n.values.end());
+            n.values.resize(mid);
+        } else {  // keys[mid] moves up; its child becomes the right node's leftmost
+            right.leftmost = n.children[mid];
+            right.keys.assign(n.keys.begin() + mid + 1, n.keys.end());
+            right.children.assign(n.children.begin() + mid + 1, n.children.end());
+            n.children.resize(mid);
+        }
+        n.keys.resize(mid);
+        return right;
+    }
+
+    // Copy-on-write insert below page id; returns the subtree's new page id
+    uint32_t insertAt(uint32_t id, const string& key, const string& value, Split& split) {
+        Node n = decode(page(id));
+        if (n.leaf) {
+            size_t pos = lower_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin();
+            if (pos < n.keys.size() && n.keys[pos] == key) {
+                n.values[pos] = value;
+            } else {
+                n.keys.insert(n.keys.begin() + pos, key);
+                n.values.insert(n.values.begin() + pos, value);
+                records++;
+            }
+        } else {
+            size_t pos = upper_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin();
+            uint32_t& child = pos == 0 ? n.leftmost : n.children[pos - 1];
+            Split below;
+            child = insertAt(child, key, value, below);
+            if (below.happened) {
+                n.keys.insert(n.keys.begin() + pos, below.key);
+                n.children.insert(n.children.begin() + pos, below.right);
+            }
+        }
+        if (encodedSize(n) <= PAGE_SIZE) return writeNode(n, id);
+        Node right = splitNode(n, split.key);
+        split.happened = true;
+        split.right = writeNode(right, 0);
+        return writeNode(n, id);
+    }
+
+    void scanPage(uint32_t id, const function<void(const string&, const string&)>& visit) const {
+        const uint8_t* p = page(id);
+        int count = read16(p + 2);
+        if (read16(p) == INNER) {
+            scanPage(read32(p + 4), visit);
+            for (int i = 0; i < count; ++i) scanPage(read32(cell(p, i) + 2), visit);
+            return;
+        }
+        string key, value;
+        for (int i = 0; i < count; ++i) {
+            const uint8_t* c = cell(p, i);
+            key.assign(reinterpret_cast<const char*>(c + 4), read16(c));
+            value.assign(reinterpret_cast<const char*>(c + 4 + read16(c)), read16(c + 2));
+            visit(key, value);
+        }
+    }
+
+    void remap() {
+        size_t want = (size_t)pageCount * PAGE_SIZE;
+        if (want <= mappedBytes) return;
+        if (mapping) munmap(const_cast<uint8_t*>(mapping), mappedBytes);
+        void* base = mmap(nullptr, want, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) throw runtime_error("cannot map " + path);
+        mapping = static_cast<const uint8_t*>(base);
+        mappedBytes = want;
+    }
+
+    void writeAll(const uint8_t* data, size_t bytes, off_t at) { writeFully(fd, data, bytes, at, path); }
+
+    // Syncs data pages, then publishes them through the other meta page
+    void commitLocked(bool force = false) {
+        if (!force && dirty.empty() && freedNow.empty()) return;
+        for (const auto& [id, bytes] : dirty) writeAll(bytes.get(), PAGE_SIZE, (off_t)id * PAGE_SIZE);
+        if (fdatasync(fd) != 0) throw runtime_error("cannot sync " + path);
+
+        uint8_t buffer[PAGE_SIZE] = {};
+        Meta m{MAGIC, generation + 1, records, root, pageCount, 0};
+        m.checksum = metaChecksum(m);
+        memcpy(buffer, &m, sizeof m);
+        writeAll(buffer, PAGE_SIZE, (off_t)(metaSlot ^ 1) * PAGE_SIZE);
+        if (fdatasync(fd) != 0) throw runtime_error("cannot sync " + path);
+        metaSlot ^= 1;
+        generation++;
+
+        dirty.clear();
+        reusable.insert(reusable.end(), freedLast.begin(), freedLast.end());
+        freedLast.swap(freedNow);
+        freedNow.clear();
+        remap();
+    }
+
+public:
+    // Opens the tree stored at path, creating an empty one if needed
+    explicit BPlusTreeStore(const string& path) : path(path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw runtime_error("cannot open " + path);
+        Meta best{};
+        bool found = false;
+        for (int slot = 0; slot < 2; ++slot) {
+            Meta m{};
+            if (pread(fd, &m, sizeof m, (off_t)slot * PAGE_SIZE) != (ssize_t)sizeof m) continue;
+            if (m.magic != MAGIC || m.checksum != metaChecksum(m)) continue;
+            if (!found || m.generation > best.generation) {
+                best = m;
+                metaSlot = slot;
+                found = true;
+            }
+        }
+        if (found) {
+            generation = best.generation;
+            root = best.root;
+            pageCount = best.pageCount;
+            records = best.records;
+            remap();
+        } else {  // New file: commit an empty tree so the meta pages exist
+            metaSlot = 1;
+            commitLocked(true);
+        }
+    }
+
+    ~BPlusTreeStore() override {
+        try {
+            commitLocked();
+        } catch (const exception& e) {
+            cerr << "B+ tree " << path << ": " << e.what() << "\n";
+        }
+        if (mapping) munmap(const_cast<uint8_t*>(mapping), mappedBytes);
+        if (fd >= 0) ::close(fd);
+    }
+
+    BPlusTreeStore(const BPlusTreeStore&) = delete;
+    BPlusTreeStore& operator=(const BPlusTreeStore&) = delete;
+
+    // Inserts or replaces a record (visible to get() at once, durable after flush())
+    // Time complexity: O(log n) pages copied
+    void put(const string& id, const string& record) override {
+        if (id.size() + record.size() > MAX_CELL) throw runtime_error("record " + id + " is too large for a B+ tree page");
+        unique_lock<shared_mutex> guard(lock);
+        if (root == 0) {
+            Node leaf;
+            leaf.keys.push_back(id);
+            leaf.values.push_back(record);
+            root = writeNode(leaf, 0);
+            records = 1;
+            return;
+        }
+        Split split;
+        uint32_t left = insertAt(root, id, record, split);
+        if (split.happened) {
+            Node top;
+            top.leaf = false;
+            top.leftmost = left;
+            top.keys.push_back(split.key);
+            top.children.push_back(split.right);
+            left = writeNode(top, 0);
+        }
+        root = left;
+    }
+
+    // Point lookup: one binary search per level directly on the page bytes
+    // Time complexity: O(log n)
+    bool get(const string& id, string& record) const override {
+        shared_lock<shared_mutex> guard(lock);
+        if (root == 0) return false;
+        const uint8_t* p = page(root);
+        while (read16(p) == INNER) {
+            int lo = 0, hi = read16(p + 2);  // First key greater than id
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (keyAt(p, mid) <= id) lo = mid + 1;
+                else hi = mid;
+            }
+            p = page(lo == 0 ? read32(p + 4) : read32(cell(p, lo - 1) + 2));
+        }
+        int lo = 0, hi = read16(p + 2);
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (keyAt(p, mid) < id) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == read16(p + 2) || keyAt(p, lo) != id) return false;
+        const uint8_t* c = cell(p, lo);
+        record.assign(reinterpret_cast<const char*>(c + 4 + read16(c)), read16(c + 2));
+        return true;
+    }
+
+    void flush() override {
+        unique_lock<shared_mutex> guard(lock);
+        commitLocked();
+    }
+
+    size_t size() const override {
+        shared_lock<shared_mutex> guard(lock);
+        return records;
+    }
+
+    // Visits records in id order (depth-first over the tree)
+    void scan(const function<void(const string&, const string&)>& visit) const override {
+        shared_lock<shared_mutex> guard(lock);
+        if (root != 0) scanPage(root, visit);
+    }
+
+    // Builds the tree from records in strictly increasing id order, supplied
+    // by next(id, record) until it returns false; the store must be empty
+    // Leaves are packed to `fill` of a page (room for later inserts) and
+    // written sequentially without passing through the page cache map
+    template <class Next>
+    void bulkLoad(Next&& next, double fill = 0.9) {
+        unique_lock<shared_mutex> guard(lock);
+        if (root != 0) throw runtime_error("bulk load needs an empty B+ tree");
+        const size_t limit = max<size_t>(PAGE_SIZE * fill, PAGE_SIZE / 2);
+        vector<uint8_t> staging;
+        staging.reserve(256 * PAGE_SIZE);
+        uint32_t stagingFirst = pageCount;
+        auto emit = [&](const Node& n) {
+            if (staging.size() == staging.capacity()) {
+                writeAll(staging.data(), staging.size(), (off_t)stagingFirst * PAGE_SIZE);
+                stagingFirst += staging.size() / PAGE_SIZE;
+                staging.clear();
+            }
+            staging.resize(staging.size() + PAGE_SIZE);
+            encode(n, staging.data() + staging.size() - PAGE_SIZE);
+            return pageCount++;
+        };
+
+        // Leaf level: (first key, page) of every node
+        vector<pair<string, uint32_t>> level;
+        Node node;
+        string id, record, previous;
+        size_t size = HEADER;
+        while (next(id, record)) {
+            if (id.size() + record.size() > MAX_CELL) throw runtime_error("record " + id + " is too large for a B+ tree page");
+            if (records > 0 && !(id > previous)) throw runtime_error("bulk load input is not sorted at " + id);
+            previous = id;
+            size_t cellSize = 2 + 4 + id.size() + record.size();
+            if (size + cellSize > limit && !node.keys.empty()) {
+                level.push_back({node.keys[0], emit(node)});
+                node.keys.clear();
+                node.values.clear();
+                size = HEADER;
+            }
+            node.keys.push_back(id);
+            node.values.push_back(record);
+            size += cellSize;
+            records++;
+        }
+        if (!node.keys.empty()) level.push_back({node.keys[0], emit(node)});
+
+        // Inner levels, bottom-up, until one node remains
+        while (level.size() > 1) {
+            vector<pair<string, uint32_t>> parents;
+            Node inner;
+            inner.leaf = false;
+            size_t at = 0;
+            while (at < level.size()) {
+                inner.leftmost = level[at].second;
+                inner.keys.clear();
+                inner.children.clear();
+                string first = level[at].first;
+                size = HEADER;
+                for (at++; at < level.size() && size + 6 + 2 + level[at].first.size() <= limit; ++at) {
+                    inner.keys.push_back(level[at].first);
+                    inner.children.push_back(level[at].second);
+                    size += 6 + 2 + level[at].first.size();
+                }
+                parents.push_back({first, emit(inner)});
+            }
+            level.swap(parents);
+        }
+        if (!staging.empty()) writeAll(staging.data(), staging.size(), (off_t)stagingFirst * PAGE_SIZE);
+        root = level.empty() ? 0 : level[0].second;
+        commitLocked(true);  // Pages bypassed the dirty map, so commit unconditionally
+    }
+};
+
+// ============================
+// Class: LSMStore (Log-Structured Merge Tree)
+// ============================
+
+// Write-optimized persistent record store for high update rates
+// - put() appends to a write-ahead log and inserts into an in-memory sorted
+//   memtable; nothing on disk is modified in place
+// - A full memtable is frozen and a background worker writes it out as an
+//   immutable sorted run (level 0) with a sparse key index and a Bloom
+//   filter, then drops its log
+// - The worker also compacts: when level 0 holds LEVEL0_RUNS runs they are
+//   merged into level 1, and level i (i >= 1) is merged down into level
+//   i + 1 once it outgrows memtable size * 10^i (one run per level)
+// - get() checks memtable, frozen memtable, then runs newest to oldest;
+//   Bloom filters skip most runs that do not hold the key
+// - A MANIFEST file (replaced atomically) lists the live runs; the logs
+//   still needed are replayed on open
+// Directory layout: MANIFEST, wal-<n>.log, run-<n>.sst
+class LSMStore : public RecordStore {
+public:
+    static constexpr int LEVEL0_RUNS = 4;
+    static constexpr int INDEX_EVERY = 16;   // Sparse index: one key per this many entries
+    static constexpr int BLOOM_BITS = 10;    // Bits per key (about 1% false positives)
+    static constexpr size_t WAL_BATCH = 64 << 10;
+
+private:
+    static constexpr uint64_t RUN_MAGIC = 0x314e5552424d534cULL;
+
+    static uint64_t fnv1a(string_view bytes) {
+        uint64_t h = 1469598103934665603ULL;
+        for (unsigned char c : bytes) h = (h ^ c) * 1099511628211ULL;
+        return h;
+    }
+
+    // Immutable sorted run file, mapped read-only
+    // Layout: entries (klen u32 | vlen u32 | key | value) in key order,
+    // sparse index (klen u32 | key | offset u64), Bloom filter bits, footer
+    class Run {
+    public:
+        struct Footer {
+            uint64_t entries;
+            uint64_t indexOffset;
+            uint64_t bloomOffset;
+            uint64_t bloomBits;
+            uint32_t bloomHashes;
+            uint32_t indexCount;
+            uint64_t magic;
+        };
+
+        uint64_t id;
+        string path;
+        Footer footer{};
+
+    private:
+        const uint8_t* base = nullptr;
+        size_t bytes = 0;
+        vector<pair<string_view, uint64_t>> index;
+
+    public:
+        Run(uint64_t id, const string& path) : id(id), path(path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw runtime_error("cannot open " + path);
+            bytes = lseek(fd, 0, SEEK_END);
+            void* mapped = bytes >= sizeof(Footer) ? mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            if (mapped == MAP_FAILED) throw runtime_error("cannot map " + path);
+            base = static_cast<const uint8_t*>(mapped);
+            memcpy(&footer, base + bytes - sizeof(Footer), sizeof(Footer));
+            if (footer.magic != RUN_MAGIC) throw runtime_error("corrupt run " + path);
+            const uint8_t* p = base + footer.indexOffset;
+            index.reserve(footer.indexCount);
+            for (uint32_t i = 0; i < footer.indexCount; ++i) {
+                uint32_t klen;
+                uint64_t offset;
+                memcpy(&klen, p, 4);
+                memcpy(&offset, p + 4 + klen, 8);
+                index.push_back({string_view(reinterpret_cast<const char*>(p + 4), klen), offset});
+                p += 12 + klen;
+            }
+        }
+
+        ~Run() { munmap(const_cast<uint8_t*>(base), bytes); }
+
+        Run(const Run&) = delete;
+        Run& operator=(const Run&) = delete;
+
+        size_t fileBytes() const { return bytes; }
+
+        bool mayContain(uint64_t hash) const {
+            const uint8_t* bloom = base + footer.bloomOffset;
+            uint64_t h2 = (hash >> 33) | 1;
+            for (uint32_t i = 0; i < footer.bloomHashes; ++i) {
+                uint64_t bit = (hash + i * h2) % footer.bloomBits;
+                if (!(bloom[bit >> 3] & (1 << (bit & 7)))) return false;
+            }
+            return true;
+        }
+
+        // Entry at offset: key, value and the offset of the next entry
+        uint64_t entryAt(uint64_t offset, string_view& key, string_view& value) const {
+            uint32_t klen, vlen;
+            memcpy(&klen, base + offset, 4);
+            memcpy(&vlen, base + offset + 4, 4);
+            key = string_view(reinterpret_cast<const char*>(base + offset + 8), klen);
+            value = string_view(key.data() + klen, vlen);
+            return offset + 8 + klen + vlen;
+        }
+
+        // Binary search of the sparse index, then a scan of at most INDEX_EVERY entries
+        bool find(const string& id, uint64_t hash, string& record) const {
+            if (index.empty() || !mayContain(hash)) return false;
+            auto it = upper_bound(index.begin(), index.end(), string_view(id),
+                                  [](string_view key, const pair<string_view, uint64_t>& e) { return key < e.first; });
+            if (it == index.begin()) return false;
+            uint64_t offset = prev(it)->second;
+            string_view key, value;
+            for (int i = 0; i < INDEX_EVERY && offset < footer.indexOffset; ++i) {
+                offset = entryAt(offset, key, value);
+                if (key == id) {
+                    record.assign(value);
+                    return true;
+                }
+                if (key > id) break;
+            }
+            return false;
+        }
+    };
+
+    // Streams sorted entries into a new run file
+    class RunWriter {
+        string path;
+        int fd;
+        vector<uint8_t> buffer, indexBytes;
+        vector<uint64_t> hashes;
+        uint64_t written = 0, entries = 0;
+        uint32_t indexCount = 0;
+
+        void append(vector<uint8_t>& out, const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+
+        void drain() {
+            writeFully(fd, buffer.data(), buffer.size(), written, path);
+            written += buffer.size();
+            buffer.clear();
+        }
+
+    public:
+        explicit RunWriter(const string& path) : path(path) {
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) throw runtime_error("cannot create " + path);
+        }
+
+        ~RunWriter() { if (fd >= 0) ::close(fd); }
+
+        void add(string_view key, string_view value) {
+            uint64_t offset = written + buffer.size();
+            if (entries % INDEX_EVERY == 0) {
+                uint32_t klen = key.size();
+                append(indexBytes, &klen, 4);
+                append(indexBytes, key.data(), key.size());
+                append(indexBytes, &offset, 8);
+                indexCount++;
+            }
+            uint32_t klen = key.size(), vlen = value.size();
+            append(buffer, &klen, 4);
+            append(buffer, &vlen, 4);
+            append(buffer, key.data(), key.size());
+            append(buffer, value.data(), value.size());
+            hashes.push_back(fnv1a(key));
+            entries++;
+            if (buffer.size() >= (1 << 20)) drain();
+        }
+
+        size_t bytesSoFar() const { return written + buffer.size(); }
+
+        // Appends index, Bloom filter and footer, then syncs the file
+        void finish() {
+            Run::Footer footer{entries, bytesSoFar(), 0, max<uint64_t>(64, entries * BLOOM_BITS), 7, indexCount, RUN_MAGIC};
+            append(buffer, indexBytes.data(), indexBytes.size());
+            footer.bloomOffset = bytesSoFar();
+            vector<uint8_t> bloom((footer.bloomBits + 7) / 8);
+            for (uint64_t hash : hashes) {
+                uint64_t h2 = (hash >> 33) | 1;
+                for (uint32_t i = 0; i < footer.bloomHashes; ++i) {
+                    uint64_t bit = (hash + i * h2) % footer.bloomBits;
+                    bloom[bit >> 3] |= 1 << (bit & 7);
+                }
+            }
+            append(buffer, bloom.data(), bloom.size());
+            append(buffer, &footer, sizeof footer);
+            drain();
+            if (fdatasync(fd) != 0) throw runtime_error("cannot sync " + path);
+            ::close(fd);
+            fd = -1;
+        }
+    };
+
+    using RunPtr = shared_ptr<const Run>;
+    using Memtable = map<string, string, less<>>;
+
+    // Live runs; levels[0] may hold several (newest first), deeper levels hold at most one
+    struct Version {
+        vector<vector<RunPtr>> levels;
+    };
+
+    string directory;
+    size_t memtableLimit;
+
+    mutable mutex lock;  // Guards everything below except the worker's private state
+    condition_variable workReady, workDone;
+    Memtable memtable;
+    size_t memtableBytes = 0;
+    shared_ptr<const Memtable> frozen;  // Being written to level 0 by the worker
+    shared_ptr<const Version> current = make_shared<Version>();
+    int walFd = -1;
+    uint64_t walId = 0, walOffset = 0;
+    string walBuffer;        // Log records not yet written to walFd
+    uint64_t walFloor = 0;   // Oldest log still needed
+    uint64_t nextRunId = 1;
+    size_t compactions = 0;
+    bool stopping = false;
+    thread worker;
+
+    string walPath(uint64_t id) const { return directory + "/wal-" + to_string(id) + ".log"; }
+    string runPath(uint64_t id) const { return directory + "/run-" + to_string(id) + ".sst"; }
+
+    static void syncDirectory(const string& directory) {
+        int fd = ::open(directory.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    // Writes the manifest for version v through a temporary file and rename
+    void writeManifest(const Version& v, uint64_t floor, uint64_t runId) const {
+        string text = "walFloor " + to_string(floor) + "\nnextRun " + to_string(runId) + "\n";
+        for (size_t level = 0; level < v.levels.size(); ++level)
+            for (const auto& run : v.levels[level]) text += "run " + to_string(level) + " " + to_string(run->id) + "\n";
+        string temporary = directory + "/MANIFEST.tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw runtime_error("cannot create " + temporary);
+        writeFully(fd, text.data(), text.size(), 0, temporary);
+        bool synced = fdatasync(fd) == 0;
+        ::close(fd);
+        if (!synced || rename(temporary.c_str(), (directory + "/MANIFEST").c_str()) != 0)
+            throw runtime_error("cannot replace " + directory + "/MANIFEST");
+        syncDirectory(directory);
+    }
+
+    // Replays a log into the memtable; a torn tail record is cut off
+    void replayLog(uint64_t id) {
+        int fd = ::open(walPath(id).c_str(), O_RDWR);
+        if (fd < 0) return;
+        string bytes(lseek(fd, 0, SEEK_END), '\0');
+        if (pread(fd, bytes.data(), bytes.size(), 0) != (ssize_t)bytes.size()) throw runtime_error("cannot read " + walPath(id));
+        size_t at = 0;
+        while (at + 12 <= bytes.size()) {
+            uint32_t klen, vlen, check;
+            memcpy(&klen, &bytes[at], 4);
+            memcpy(&vlen, &bytes[at + 4], 4);
+            memcpy(&check, &bytes[at + 8], 4);
+            if (at + 12 + (uint64_t)klen + vlen > bytes.size()) break;
+            string_view body(&bytes[at + 12], klen + vlen);
+            if ((uint32_t)fnv1a(body) != check) break;
+            insertMemtable(string(body.substr(0, klen)), string(body.substr(klen)));
+            at += 12 + klen + vlen;
+        }
+        if (at < bytes.size() && ftruncate(fd, at) != 0) throw runtime_error("cannot truncate " + walPath(id));
+        if (walFd >= 0) ::close(walFd);
+        walFd = fd;
+        walId = id;
+        walOffset = at;
+    }
+
+    // Hands buffered log records to the OS (one write for many puts)
+    void drainLog() {
+        if (walBuffer.empty()) return;
+        writeFully(walFd, walBuffer.data(), walBuffer.size(), walOffset, walPath(walId));
+        walOffset += walBuffer.size();
+        walBuffer.clear();
+    }
+
+    void openLog(uint64_t id) {
+        if (walFd >= 0) ::close(walFd);
+        walFd = ::open(walPath(id).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (walFd < 0) throw runtime_error("cannot create " + walPath(id));
+        walId = id;
+        walOffset = 0;
+    }
+
+    void insertMemtable(string id, string record) {
+        auto [it, inserted] = memtable.try_emplace(move(id));
+        if (inserted) memtableBytes += it->first.size() + 48;
+        memtableBytes += record.size();
+        memtableBytes -= it->second.size();
+        it->second = move(record);
+    }
+
+    uint64_t levelLimit(size_t level) const {
+        uint64_t limit = memtableLimit;
+        for (size_t i = 0; i < level; ++i) limit *= 10;
+        return limit;
+    }
+
+    // Next compaction as (source level, target level), or (-1, -1)
+    pair<int, int> pickCompaction(const Version& v) const {
+        if ((int)v.levels[0].size() >= LEVEL0_RUNS) return {0, 1};
+        for (size_t level = 1; level < v.levels.size(); ++level)
+            if (!v.levels[level].empty() && v.levels[level][0]->fileBytes() > levelLimit(level)) return {(int)level, (int)level + 1};
+        return {-1, -1};
+    }
+
+    // Visits the keys of runs (newest first) in order, each once with its newest value
+    template <class Visit>
+    static void forEachMerged(const vector<RunPtr>& runs, Visit&& visit) {
+        struct Cursor {
+            const Run* run;
+            uint64_t offset;
+            string_view key, value;
+        };
+        vector<Cursor> cursors;
+        for (const auto& run : runs) {
+            Cursor c{run.get(), 0, {}, {}};
+            if (run->footer.entries > 0) {
+                c.offset = run->entryAt(0, c.key, c.value);
+                cursors.push_back(c);
+            }
+        }
+        while (!cursors.empty()) {
+            size_t best = 0;
+            for (size_t i = 1; i < cursors.size(); ++i)
+                if (cursors[i].key < cursors[best].key) best = i;  // Ties keep the newer (earlier) cursor
+            string_view key = cursors[best].key;
+            visit(key, cursors[best].value);
+            for (size_t i = cursors.size(); i-- > 0;) {
+                Cursor& c = cursors[i];
+                if (c.key != key) continue;
+                if (c.offset < c.run->footer.indexOffset) c.offset = c.run->entryAt(c.offset, c.key, c.value);
+                else cursors.erase(cursors.begin() + i);
+            }
+        }
+    }
+
+    // Visits each id once with its newest value: buffered records, then
+    // run records not shadowed by them
+    template <class Visit>
+    void scanNewest(Visit&& visit) const {
+        shared_ptr<const Version> version;
+        Memtable buffered;
+        {
+            lock_guard<mutex> guard(lock);
+            buffered = memtable;
+            if (frozen) buffered.insert(frozen->begin(), frozen->end());  // Keeps the newer memtable value
+            version = current;
+        }
+        vector<RunPtr> runs;
+        for (const auto& level : version->levels) runs.insert(runs.end(), level.begin(), level.end());
+        for (const auto& [key, value] : buffered) visit(key, value);
+        forEachMerged(runs, [&](string_view key, string_view value) {
+            if (!buffered.count(key)) visit(key, value);
+        });
+    }
+
+    // Merges runs (newest first) into a new run
+    RunPtr mergeRuns(const vector<RunPtr>& runs, uint64_t id) {
+        RunWriter out(runPath(id));
+        forEachMerged(runs, [&](string_view key, string_view value) { out.add(key, value); });
+        out.finish();
+        return make_shared<const Run>(id, runPath(id));
+    }
+
+    // Background worker: writes frozen memtables to level 0 and compacts levels
+    void backgroundLoop() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            workReady.wait(guard, [&] { return stopping || frozen || pickCompaction(*current).first >= 0; });
+            if (frozen) {
+                auto table = frozen;
+                uint64_t id = nextRunId++, floor = walId;
+                guard.unlock();
+                RunWriter out(runPath(id));
+                for (const auto& [key, value] : *table) out.add(key, value);
+                out.finish();
+                auto run = make_shared<const Run>(id, runPath(id));
+                guard.lock();
+                auto next = make_shared<Version>(*current);
+                next->levels[0].insert(next->levels[0].begin(), run);
+                writeManifest(*next, floor, nextRunId);
+                for (uint64_t old = walFloor; old < floor; ++old) unlink(walPath(old).c_str());
+                walFloor = floor;
+                current = next;
+                frozen.reset();
+                workDone.notify_all();
+                continue;
+            }
+            if (stopping) return;
+
+            // Only this thread replaces runs, so the inputs stay in place while merging
+            auto [from, to] = pickCompaction(*current);
+            auto base = current;
+            vector<RunPtr> inputs = base->levels[from];
+            if ((size_t)to < base->levels.size()) inputs.insert(inputs.end(), base->levels[to].begin(), base->levels[to].end());
+            uint64_t id = nextRunId++;
+            guard.unlock();
+            RunPtr merged = mergeRuns(inputs, id);
+            guard.lock();
+            auto next = make_shared<Version>(*current);  // Level 0 may have gained runs meanwhile
+            auto& source = next->levels[from];
+            source.erase(source.end() - base->levels[from].size(), source.end());
+            if ((size_t)to >= next->levels.size()) next->levels.resize(to + 1);
+            next->levels[to] = {merged};
+            writeManifest(*next, walFloor, nextRunId);
+            for (const auto& run : inputs) unlink(run->path.c_str());  // Mapped readers keep their copy
+            current = next;
+            compactions++;
+        }
+    }
+
+public:
+    // Opens (or creates) the store in directory; memtableBytes sets when the
+    // memtable is written out and scales the level size limits
+    explicit LSMStore(const string& directory, size_t memtableBytes = 4 << 20)
+        : directory(directory), memtableLimit(memtableBytes) {
+        mkdir(directory.c_str(), 0755);
+        auto version = make_shared<Version>();
+        version->levels.resize(1);
+        int fd = ::open((directory + "/MANIFEST").c_str(), O_RDONLY);
+        if (fd >= 0) {
+            string text(lseek(fd, 0, SEEK_END), '\0');
+            bool ok = pread(fd, text.data(), text.size(), 0) == (ssize_t)text.size();
+            ::close(fd);
+            if (!ok) throw runtime_error("cannot read " + directory + "/MANIFEST");
+            istringstream in(text);
+            string word;
+            while (in >> word) {
+                if (word == "walFloor") in >> walFloor;
+                else if (word == "nextRun") in >> nextRunId;
+                else if (word == "run") {
+                    size_t level;
+                    uint64_t id;
+                    in >> level >> id;
+                    if (level >= version->levels.size()) version->levels.resize(level + 1);
+                    version->levels[level].push_back(make_shared<const Run>(id, runPath(id)));
+                }
+            }
+        }
+        current = version;
+
+        // Logs from walFloor on are numbered consecutively
+        uint64_t id = walFloor;
+        while (access(walPath(id).c_str(), F_OK) == 0) replayLog(id++);
+        if (walFd < 0) openLog(walFloor);
+        worker = thread([this] { backgroundLoop(); });
+    }
+
+    ~LSMStore() override {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+            try {
+                drainLog();
+            } catch (const exception& e) {
+                cerr << "LSM store " << directory << ": " << e.what() << "\n";
+            }
+            if (walFd >= 0) fdatasync(walFd);
+        }
+        workReady.notify_all();
+        worker.join();
+        if (walFd >= 0) ::close(walFd);
+    }
+
+    LSMStore(const LSMStore&) = delete;
+    LSMStore& operator=(const LSMStore&) = delete;
+
+    // Logs and buffers one record; durable after flush()
+    // Log records are written in batches of WAL_BATCH bytes
+    // Waits only if the previous memtable is still being written out
+    // Time complexity: O(log m) for a memtable of m records
+    void put(const string& id, const string& record) override {
+        uint32_t klen = id.size(), vlen = record.size();
+        unique_lock<mutex> guard(lock);
+        size_t at = walBuffer.size();
+        walBuffer.resize(at + 12 + klen + vlen);
+        char* entry = &walBuffer[at];
+        memcpy(entry, &klen, 4);
+        memcpy(entry + 4, &vlen, 4);
+        memcpy(entry + 12, id.data(), klen);
+        memcpy(entry + 12 + klen, record.data(), vlen);
+        uint32_t check = fnv1a(string_view(entry + 12, klen + vlen));
+        memcpy(entry + 8, &check, 4);
+        if (walBuffer.size() >= WAL_BATCH) drainLog();
+        insertMemtable(id, record);
+        if (memtableBytes < memtableLimit) return;
+        workDone.wait(guard, [&] { return !frozen; });
+        drainLog();
+        frozen = make_shared<const Memtable>(move(memtable));
+        memtable.clear();
+        memtableBytes = 0;
+        openLog(walId + 1);
+        workReady.notify_one();
+    }
+
+    // Checks memtable, frozen memtable, then runs from newest to oldest
+    // Time complexity: O(log m) + one index search per run the Bloom filter admits
+    bool get(const string& id, string& record) const override {
+        shared_ptr<const Version> version;
+        {
+            lock_guard<mutex> guard(lock);
+            auto it = memtable.find(id);
+            if (it != memtable.end()) {
+                record = it->second;
+                return true;
+            }
+            if (frozen && (it = frozen->find(id)) != frozen->end()) {
+                record = it->second;
+                return true;
+            }
+            version = current;
+        }
+        uint64_t hash = fnv1a(id);
+        for (const auto& level : version->levels)
+            for (const auto& run : level)
+                if (run->find(id, hash, record)) return true;
+        return false;
+    }
+
+    // Writes and syncs the active log; buffered records survive a crash afterwards
+    void flush() override {
+        lock_guard<mutex> guard(lock);
+        drainLog();
+        if (fdatasync(walFd) != 0) throw runtime_error("cannot sync " + walPath(walId));
+    }
+
+    // Distinct ids across memtables and runs
+    // Time complexity: O(n log m), a full merge of all levels
+    size_t size() const override {
+        size_t count = 0;
+        scanNewest([&](string_view, string_view) { count++; });
+        return count;
+    }
+
+    // Visits the newest value of every id, from a consistent snapshot
+    void scan(const function<void(const string&, const string&)>& visit) const override {
+        string key, value;
+        scanNewest([&](string_view k, string_view v) {
+            key.assign(k);
+            value.assign(v);
+            visit(key, value);
+        });
+    }
+
+    // Run count per level, newest level first, e.g. "L0:2 L1:1 L2:1"
+    string describeLevels() const {
+        lock_guard<mutex> guard(lock);
+        string text;
+        for (size_t level = 0; level < current->levels.size(); ++level)
+            text += (level ? " L" : "L") + to_string(level) + ":" + to_string(current->levels[level].size());
+        return text + " (" + to_string(compactions) + " compactions)";
+    }
+};
+
+// ============================
+// Struct: PatientFields (Parsed Record)
+// ============================
+
+// Structured view of a record written as "Name - Visit Year",
+// e.g. "John Doe - Checkup 2023" -> {"John Doe", "Checkup", 2023}
+struct PatientFields {
+    string name;
+    string visit;
+    int year = 0;  // 0 if the record has no trailing year
+};
+
+// Parses "Name - Visit Year"; false if the record has no " - " separator
+bool parsePatientRecord(const string& record, PatientFields& fields) {
+    size_t dash = record.find(" - ");
+    if (dash == string::npos) return false;
+    fields.name = record.substr(0, dash);
+    fields.visit = record.substr(dash + 3);
+    fields.year = 0;
+    size_t space = fields.visit.find_last_of(' ');
+    string last = fields.visit.substr(space == string::npos ? 0 : space + 1);
+    if (!last.empty() && last.size() <= 9 && all_of(last.begin(), last.end(), [](unsigned char c) { return isdigit(c); })) {
+        fields.year = stoi(last);
+        fields.visit.resize(space == string::npos ? 0 : space);
+    }
+    return true;
+}
+
+// ============================
+// Class: RecordIndex (Sorted-Array Secondary Indexes)
+// ============================
+
+// In-memory indexes over patient records for ordered and field queries
+// - Every id gets a row; the id index is an array of row numbers sorted by id
+// - The name index holds (interned name, row) pairs and the year index
+//   (year, row) pairs, each sorted by key then row: 8 bytes per entry
+// - New entries are appended to a pending list and merged into the sorted
+//   array (sort + in-place merge) before the next query, so a burst of
+//   updates costs O(k log k + n) once instead of O(n) each
+// - When a record's name or year changes the old entry stays behind and is
+//   skipped at query time (its key no longer matches the row); the array is
+//   compacted once stale entries make up half of it
+// Scans walk the sorted arrays with lower_bound / upper_bound iterators, so
+// their cost is O(log n + matches). Ids compare as plain strings, so ranges
+// such as P100..P199 assume same-width numbers
+class RecordIndex {
+private:
+    static constexpr uint32_t NO_NAME = UINT32_MAX;
+
+    struct Row {
+        string id;
+        uint32_t name = NO_NAME;  // Interned name, NO_NAME if unparsed
+        int year = 0;
+    };
+
+    struct Entry {
+        uint32_t key;  // Interned name or year
+        uint32_t row;
+        bool operator==(const Entry& other) const { return key == other.key && row == other.row; }
+    };
+
+    vector<Row> rows;
+    unordered_map<string, uint32_t> rowOf;
+    vector<string> names;
+    unordered_map<string, uint32_t> nameIds;
+
+    // Sorted arrays plus their pending (unsorted) additions; queries merge
+    // the pending entries in, hence mutable
+    mutable vector<uint32_t> byId, byIdPending;
+    mutable vector<Entry> byName, byNamePending, byYear, byYearPending;
+    mutable size_t staleNames = 0, staleYears = 0;
+
+    mutable shared_mutex lock;
+
+    bool idLess(uint32_t a, uint32_t b) const { return rows[a].id < rows[b].id; }
+    bool nameLess(const Entry& a, const Entry& b) const {
+        if (a.key != b.key) return names[a.key] < names[b.key];
+        return a.row < b.row;
+    }
+    static bool yearLess(const Entry& a, const Entry& b) {
+        return a.key != b.key ? (int)a.key < (int)b.key : a.row < b.row;
+    }
+
+    template <class T, class Less>
+    static void mergePending(vector<T>& sorted, vector<T>& pending, Less less) {
+        if (pending.empty()) return;
+        sort(pending.begin(), pending.end(), less);
+        size_t middle = sorted.size();
+        sorted.insert(sorted.end(), pending.begin(), pending.end());
+        inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end(), less);
+        pending.clear();
+    }
+
+    // Drops entries whose row has moved to another key, and duplicates
+    template <class Current>
+    static void compact(vector<Entry>& sorted, size_t& stale, Current current) {
+        if (stale * 2 < sorted.size()) return;
+        size_t kept = 0;
+        for (size_t i = 0; i < sorted.size(); ++i)
+            if (current(sorted[i]) && (kept == 0 || !(sorted[kept - 1] == sorted[i]))) sorted[kept++] = sorted[i];
+        sorted.resize(kept);
+        stale = 0;
+    }
+
+    bool settled() const { return byIdPending.empty() && byNamePending.empty() && byYearPending.empty(); }
+
+    void settle() const {
+        mergePending(byId, byIdPending, [&](uint32_t a, uint32_t b) { return idLess(a, b); });
+        mergePending(byName, byNamePending, [&](const Entry& a, const Entry& b) { return nameLess(a, b); });
+        mergePending(byYear, byYearPending, yearLess);
+        compact(byName, staleNames, [&](const Entry& e) { return rows[e.row].name == e.key; });
+        compact(byYear, staleYears, [&](const Entry& e) { return (uint32_t)rows[e.row].year == e.key; });
+    }
+
+    // Runs a query on settled arrays, merging pending entries first if needed
+    template <class Query>
+    void query(Query&& body) const {
+        {
+            shared_lock<shared_mutex> guard(lock);
+            if (settled()) return body();
+        }
+        unique_lock<shared_mutex> guard(lock);
+        settle();
+        body();
+    }
+
+    // Visits rows of entries in [first, last) that are current, skipping
+    // stale entries and duplicates (identical entries are adjacent)
+    template <class It, class Current, class Visit>
+    void visitEntries(It first, It last, Current current, Visit& visit) const {
+        for (It it = first; it != last; ++it)
+            if (current(*it) && (it == first || !(*prev(it) == *it))) visit(rows[it->row].id);
+    }
+
+public:
+    // Indexes (or re-indexes) the record stored under id; read(record) fetches
+    // its current value and runs under the index lock, so the last update of
+    // an id always sees the last write even with concurrent writers
+    // Time complexity: O(1) expected plus amortized merge work at the next query
+    template <class Read>
+    void update(const string& id, Read&& read) {
+        unique_lock<shared_mutex> guard(lock);
+        string record;
+        if (!read(record)) return;
+        PatientFields fields;
+        bool parsed = parsePatientRecord(record, fields);
+        auto [it, added] = rowOf.try_emplace(id, (uint32_t)rows.size());
+        uint32_t row = it->second;
+        if (added) {
+            rows.push_back({id, NO_NAME, 0});
+            byIdPending.push_back(row);
+        }
+        uint32_t name = NO_NAME;
+        if (parsed) {
+            auto [entry, fresh] = nameIds.try_emplace(fields.name, (uint32_t)names.size());
+            if (fresh) names.push_back(fields.name);
+            name = entry->second;
+        }
+        Row& r = rows[row];
+        if (name != r.name) {
+            if (r.name != NO_NAME) staleNames++;
+            if (name != NO_NAME) byNamePending.push_back({name, row});
+            r.name = name;
+        }
+        if (fields.year != r.year) {
+            if (r.year != 0) staleYears++;
+            if (fields.year != 0) byYearPending.push_back({(uint32_t)fields.year, row});
+            r.year = fields.year;
+        }
+    }
+
+    // Visits ids in [from, to] in order
+    // Visitors run under the index lock and must not add records
+    template <class Visit>
+    void scanIdRange(const string& from, const string& to, Visit&& visit) const {
+        query([&] {
+            auto first = lower_bound(byId.begin(), byId.end(), from, [&](uint32_t r, const string& key) { return rows[r].id < key; });
+            for (auto it = first; it != byId.end() && rows[*it].id <= to; ++it) visit(rows[*it].id);
+        });
+    }
+
+    // Visits ids starting with prefix in order
+    template <class Visit>
+    void scanIdPrefix(const string& prefix, Visit&& visit) const {
+        query([&] {
+            auto first = lower_bound(byId.begin(), byId.end(), prefix, [&](uint32_t r, const string& key) { return rows[r].id < key; });
+            for (auto it = first; it != byId.end() && rows[*it].id.compare(0, prefix.size(), prefix) == 0; ++it) visit(rows[*it].id);
+        });
+    }
+
+    // Visits ids of records whose name starts with prefix (whole names when
+    // exact), grouped by name in order, ids in insertion order within a name
+    template <class Visit>
+    void scanName(const string& prefix, bool exact, Visit&& visit) const {
+        query([&] {
+            auto below = [&](const Entry& e, const string& key) { return names[e.key] < key; };
+            auto first = lower_bound(byName.begin(), byName.end(), prefix, below);
+            auto last = first;
+            while (last != byName.end() && (exact ? names[last->key] == prefix : names[last->key].compare(0, prefix.size(), prefix) == 0)) ++last;
+            visitEntries(first, last, [&](const Entry& e) { return rows[e.row].name == e.key; }, visit);
+        });
+    }
+
+    // Visits ids of records with a visit year in [from, to], by year
+    template <class Visit>
+    void scanYears(int from, int to, Visit&& visit) const {
+        query([&] {
+            auto first = lower_bound(byYear.begin(), byYear.end(), Entry{(uint32_t)from, 0}, yearLess);
+            auto last = upper_bound(first, byYear.end(), Entry{(uint32_t)to, UINT32_MAX}, yearLess);
+            visitEntries(first, last, [&](const Entry& e) { return (uint32_t)rows[e.row].year == e.key; }, visit);
+        });
+    }
+
+    size_t size() const {
+        shared_lock<shared_mutex> guard(lock);
+        return rows.size();
+    }
+};
+
+// ============================
+// Class: TextIndex (Inverted Index with BM25 Ranking)
+// ============================
+
+// Full-text search over record text
+// - Text is split into lowercase ASCII letter/digit tokens
+// - Each document (one version of one record) gets an increasing number,
+//   so posting lists only ever grow at the end and are stored as
+//   varint-encoded (doc delta, term frequency) pairs
+// - Updating a record retires its old document and appends a new one;
+//   retired documents are skipped when lists are decoded, and all lists
+//   are renumbered once retired documents outnumber live ones
+// - Multi-term queries are AND queries: lists are decoded rarest first and
+//   intersected (SSE2 block compare, or galloping when one list is much
+//   shorter), and matches are ranked by BM25
+class TextIndex {
+public:
+    struct Hit {
+        string id;
+        double score;
+    };
+
+    static constexpr double BM25_K1 = 1.2, BM25_B = 0.75;
+
+private:
+    static constexpr uint32_t RETIRED = UINT32_MAX;
+
+    struct Postings {
+        vector<uint8_t> bytes;  // varint(doc - previous doc), varint(term frequency)
+        uint32_t lastDoc = 0;
+        uint32_t documents = 0;  // Live documents containing the term
+    };
+
+    unordered_map<string, uint32_t> termIds;
+    vector<Postings> postings;
+
+    // Per document: record id, length in tokens, distinct terms (pooled)
+    vector<string> docIds;
+    vector<uint32_t> docLength, docTermStart, termPool;
+    unordered_map<string, uint32_t> docOf;  // Record id -> live document
+    size_t liveDocs = 0, retiredDocs = 0;
+    uint64_t liveTokens = 0;
+
+    mutable shared_mutex lock;
+
+    static void putVarint(vector<uint8_t>& out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    static uint32_t getVarint(const uint8_t*& p) {
+        uint32_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = *p++;
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+    }
+
+    bool live(uint32_t doc) const { return docLength[doc] != RETIRED; }
+
+    // Decodes the live (doc, frequency) pairs of one term
+    void decode(const Postings& list, vector<uint32_t>& docs, vector<uint32_t>& freqs) const {
+        docs.clear();
+        freqs.clear();
+        const uint8_t* p = list.bytes.data();
+        const uint8_t* end = p + list.bytes.size();
+        uint32_t doc = 0;
+        while (p < end) {
+            doc += getVarint(p);
+            uint32_t tf = getVarint(p);
+            if (live(doc)) {
+                docs.push_back(doc);
+                freqs.push_back(tf);
+            }
+        }
+    }
+
+    void retire(uint32_t doc) {
+        for (uint32_t i = docTermStart[doc]; i < docTermStart[doc + 1]; ++i) postings[termPool[i]].documents--;
+        liveTokens -= docLength[doc];
+        docLength[doc] = RETIRED;
+        liveDocs--;
+        retiredDocs++;
+    }
+
+    // Drops retired documents and renumbers the rest (order is kept)
+    void compact() {
+        vector<uint32_t> renumber(docIds.size(), RETIRED);
+        uint32_t next = 0;
+        for (uint32_t doc = 0; doc < docIds.size(); ++doc)
+            if (live(doc)) renumber[doc] = next++;
+        for (Postings& list : postings) {
+            vector<uint8_t> bytes;
+            const uint8_t* p = list.bytes.data();
+            const uint8_t* end = p + list.bytes.size();
+            uint32_t doc = 0, previous = 0;
+            while (p < end) {
+                doc += getVarint(p);
+                uint32_t tf = getVarint(p);
+                if (renumber[doc] == RETIRED) continue;
+                putVarint(bytes, renumber[doc] - previous);
+                putVarint(bytes, tf);
+                previous = renumber[doc];
+            }
+            list.bytes.swap(bytes);
+            list.lastDoc = previous;
+        }
+        vector<string> ids;
+        vector<uint32_t> lengths, starts{0}, pool;
+        for (uint32_t doc = 0; doc < docIds.size(); ++doc) {
+            if (!live(doc)) continue;
+            docOf[docIds[doc]] = ids.size();
+            ids.push_back(move(docIds[doc]));
+            lengths.push_back(docLength[doc]);
+            pool.insert(pool.end(), termPool.begin() + docTermStart[doc], termPool.begin() + docTermStart[doc + 1]);
+            starts.push_back(pool.size());
+        }
+        docIds.swap(ids);
+        docLength.swap(lengths);
+        docTermStart.swap(starts);
+        termPool.swap(pool);
+        retiredDocs = 0;
+    }
+
+    // Sorted intersection of a and b into out
+    static void intersect(const vector<uint32_t>& a, const vector<uint32_t>& b, vector<uint32_t>& out) {
+        out.clear();
+        if (a.size() > b.size()) return intersect(b, a, out);
+        size_t i = 0, j = 0;
+        if (a.size() * 32 < b.size()) {  // Galloping: binary search the long list
+            for (; i < a.size() && j < b.size(); ++i) {
+                size_t step = 1;
+                while (j + step < b.size() && b[j + step] < a[i]) step *= 2;
+                j = lower_bound(b.begin() + j, b.begin() + min(j + step + 1, b.size()), a[i]) - b.begin();
+                if (j < b.size() && b[j] == a[i]) out.push_back(a[i]);
+            }
+            return;
+        }
+#ifdef __SSE2__
+        // Compare 4 x 4 doc numbers per step: a block against all rotations
+        // of b's block, then advance whichever block ends lower
+        while (i + 4 <= a.size() && j + 4 <= b.size()) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a.data() + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b.data() + j));
+            __m128i hit = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+                _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+            for (int k = 0; k < 4; ++k)
+                if (mask & (1 << k)) out.push_back(a[i + k]);
+            uint32_t lastA = a[i + 3], lastB = b[j + 3];
+            if (lastA <= lastB) i += 4;
+            if (lastB <= lastA) j += 4;
+        }
+#endif
+        while (i < a.size() && j < b.size()) {
+            if (a[i] < b[j]) i++;
+            else if (b[j] < a[i]) j++;
+            else {
+                out.push_back(a[i]);
+                i++;
+                j++;
+            }
+        }
+    }
+
+public:
+    // Splits text into lowercase letter/digit tokens
+    static vector<string> tokenize(const string& text) {
+        vector<string> tokens;
+        string token;
+        for (unsigned char c : text) {
+            if (isalnum(c)) {
+                token += (char)tolower(c);
+            } else if (!token.empty()) {
+                tokens.push_back(move(token));
+                token.clear();
+            }
+        }
+        if (!token.empty()) tokens.push_back(move(token));
+        return tokens;
+    }
+
+    // Indexes the current text of record id; read(record) fetches it under
+    // the index lock (see RecordIndex::update)
+    // Time complexity: O(tokens), amortized over occasional renumbering
+    template <class Read>
+    void update(const string& id, Read&& read) {
+        unique_lock<shared_mutex> guard(lock);
+        string record;
+        if (!read(record)) return;
+        vector<string> tokens = tokenize(record);
+        sort(tokens.begin(), tokens.end());
+
+        auto [it, added] = docOf.try_emplace(id, (uint32_t)docIds.size());
+        if (!added) {
+            retire(it->second);
+            it->second = docIds.size();
+        }
+        uint32_t doc = docIds.size();
+        docIds.push_back(id);
+        docLength.push_back(tokens.size());
+        if (docTermStart.empty()) docTermStart.push_back(0);
+        for (size_t i = 0; i < tokens.size();) {
+            size_t j = i;
+            while (j < tokens.size() && tokens[j] == tokens[i]) j++;
+            auto [term, fresh] = termIds.try_emplace(tokens[i], (uint32_t)postings.size());
+            if (fresh) postings.emplace_back();
+            Postings& list = postings[term->second];
+            putVarint(list.bytes, doc - list.lastDoc);
+            putVarint(list.bytes, j - i);
+            list.lastDoc = doc;
+            list.documents++;
+            termPool.push_back(term->second);
+            i = j;
+        }
+        docTermStart.push_back(termPool.size());
+        liveDocs++;
+        liveTokens += tokens.size();
+        if (retiredDocs > liveDocs && retiredDocs > 1024) compact();
+    }
+
+    // Records containing every query term, best BM25 score first
+    // Time complexity: O(total postings of the query terms + matches log limit)
+    vector<Hit> search(const string& query, size_t limit = 10) const {
+        vector<string> terms = tokenize(query);
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+        shared_lock<shared_mutex> guard(lock);
+        vector<const Postings*> lists;
+        for (const string& term : terms) {
+            auto it = termIds.find(term);
+            if (it == termIds.end() || postings[it->second].documents == 0) return {};
+            lists.push_back(&postings[it->second]);
+        }
+        if (lists.empty()) return {};
+        sort(lists.begin(), lists.end(), [](const Postings* a, const Postings* b) { return a->documents < b->documents; });
+
+        vector<vector<uint32_t>> docs(lists.size()), freqs(lists.size());
+        vector<uint32_t> matches, scratch;
+        for (size_t t = 0; t < lists.size(); ++t) {
+            decode(*lists[t], docs[t], freqs[t]);
+            if (t == 0) {
+                matches = docs[0];
+            } else {
+                intersect(matches, docs[t], scratch);
+                matches.swap(scratch);
+            }
+            if (matches.empty()) return {};
+        }
+
+        double average = (double)liveTokens / liveDocs;
+        vector<double> scores(matches.size(), 0.0);
+        for (size_t t = 0; t < lists.size(); ++t) {
+            double df = lists[t]->documents;
+            double idf = log(1 + (liveDocs - df + 0.5) / (df + 0.5));
+            size_t at = 0;
+            for (size_t m = 0; m < matches.size(); ++m) {  // Both sorted: one merge pass
+                while (docs[t][at] != matches[m]) at++;
+                double tf = freqs[t][at];
+                double norm = BM25_K1 * (1 - BM25_B + BM25_B * docLength[matches[m]] / average);
+                scores[m] += idf * tf * (BM25_K1 + 1) / (tf + norm);
+            }
+        }
+        vector<uint32_t> order(matches.size());
+        for (uint32_t m = 0; m < order.size(); ++m) order[m] = m;
+        size_t top = min(limit, order.size());
+        partial_sort(order.begin(), order.begin() + top, order.end(), [&](uint32_t a, uint32_t b) {
+            return scores[a] != scores[b] ? scores[a] > scores[b] : matches[a] < matches[b];
+        });
+        vector<Hit> hits;
+        for (size_t m = 0; m < top; ++m) hits.push_back({docIds[matches[order[m]]], scores[order[m]]});
+        return hits;
+    }
+
+    // Number of live records containing the term
+    size_t documentFrequency(const string& term) const {
+        shared_lock<shared_mutex> guard(lock);
+        auto it = termIds.find(term);
+        return it == termIds.end() ? 0 : postings[it->second].documents;
+    }
+
+    // Encoded size of all posting lists
+    size_t postingBytes() const {
+        shared_lock<shared_mutex> guard(lock);
+        size_t total = 0;
+        for (const Postings& list : postings) total += list.bytes.size();
+        return total;
+    }
+};
+
+// ============================
+// Class: PatientRecordSystem (Pluggable Storage Engine)
+// ============================
+
+// Manages patient records through a pluggable storage engine
+// By default records live in a sharded concurrent hash table (O(1) expected
+// search and insert, many readers alongside writers); for persistence a
+// disk-backed B+ tree (read-heavy) or LSM tree (update-heavy) can be supplied
+// Optional secondary indexes on ID order, patient name and visit year answer
+// range and field queries, and a full-text index answers term searches,
+// without scanning every record
+// - Indexes are opt-in (Indexing::Fields or Indexing::Full); without them
+//   opening a disk-backed engine is O(1) and writers touch only the store
+// - Writers do not update the indexes themselves: addRecord queues the ID
+//   on one of PENDING_SHARDS small locked lists, and the queued IDs are
+//   indexed in one batch by the next indexed query, or by the writer that
+//   queues the CATCH_UP_BATCH-th ID, so concurrent writers share no lock
+//   on the common path
+// - Records already in an engine are indexed by the first indexed query,
+//   not on construction
 class PatientRecordSystem {
+public:
+    enum class Indexing {
+        None,    // Store only: ID lookups and scans
+        Fields,  // Plus ID order, name and visit-year indexes
+        Full     // Plus the full-text index
+    };
+
 private:
-    // Balanced BST storing patient records
+    static constexpr size_t PENDING_SHARDS = 64;
+    static constexpr size_t CATCH_UP_BATCH = 4096;
+
+    struct PendingShard {
+        mutex lock;
+        vector<string> ids;  // Records written since the last catch-up
+    };
+
+    // Storage engine for patient records
     // Key: patient ID, Value: patient record information
-    map<string, string> records;
+    unique_ptr<RecordStore> store;
+    ShardedRecordStore* memory = nullptr;  // Set when the engine is the in-memory store
+    Indexing indexing;
+
+    // Queries are const but bring the indexes up to date first, hence mutable
+    mutable RecordIndex index;
+    mutable TextIndex text;
+    mutable array<PendingShard, PENDING_SHARDS> pending;
+    mutable atomic<size_t> pendingCount{0};
+    mutable atomic<bool> backfilled{false};  // Records already in the engine are indexed
+    mutable mutex catchUpLock;
+
+    // Indexes the queued IDs (and, the first time, every stored record)
+    // If wait is false and another thread is catching up, returns at once
+    void catchUp(bool wait) const {
+        if (indexing == Indexing::None) return;
+        if (backfilled.load(memory_order_acquire) && pendingCount.load(memory_order_acquire) == 0) return;
+        unique_lock<mutex> guard(catchUpLock, defer_lock);
+        if (wait) guard.lock();
+        else if (!guard.try_lock()) return;
+
+        // IDs are collected first and indexed outside the store's locks
+        vector<string> ids;
+        if (!backfilled.load(memory_order_relaxed)) {
+            store->scan([&](const string& id, const string&) { ids.push_back(id); });
+            backfilled.store(true, memory_order_release);
+        }
+        // A writer queues its ID before counting it, so every ID counted
+        // here is already on its list
+        if (pendingCount.exchange(0, memory_order_acq_rel) > 0)
+            for (PendingShard& shard : pending) {
+                lock_guard<mutex> shardGuard(shard.lock);
+                move(shard.ids.begin(), shard.ids.end(), back_inserter(ids));
+                shard.ids.clear();
+            }
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        // Each record is read after its ID was queued, so it is at least
+        // as new as the write that queued it
+        for (const string& id : ids) {
+            auto latest = [&](string& record) { return store->get(id, record); };
+            index.update(id, latest);
+            if (indexing == Indexing::Full) text.update(id, latest);
+        }
+    }
+
+    const RecordIndex& fieldIndex() const {
+        if (indexing == Indexing::None) throw runtime_error("field indexes are off; construct with Indexing::Fields");
+        catchUp(true);
+        return index;
+    }
+
+    const TextIndex& fullText() const {
+        if (indexing != Indexing::Full) throw runtime_error("the full-text index is off; construct with Indexing::Full");
+        catchUp(true);
+        return text;
+    }
+
+    template <class Scan>
+    static vector<string> collect(Scan&& scan) {
+        vector<string> ids;
+        scan([&](const string& id) { ids.push_back(id); });
+        return ids;
+    }
+
+public:
+    using RecordHandle = ShardedRecordStore::Handle;
+    using RecordSnapshot = ShardedRecordStore::Snapshot;
+
+    explicit PatientRecordSystem(Indexing indexing = Indexing::None) : indexing(indexing) {
+        auto sharded = make_unique<ShardedRecordStore>();
+        memory = sharded.get();
+        store = move(sharded);
+    }
+
+    // Uses the given storage engine, e.g. make_unique<BPlusTreeStore>("patients.db")
+    // or make_unique<LSMStore>("patients-lsm")
+    // Opening does not read the records; with indexing on, the first
+    // indexed query indexes the records already in the engine
+    explicit PatientRecordSystem(unique_ptr<RecordStore> engine, Indexing indexing = Indexing::None)
+        : store(move(engine)), indexing(indexing) {
+        memory = dynamic_cast<ShardedRecordStore*>(store.get());
+    }
+
+    // Adds a new patient record to the system
+    // If patient ID already exists, updates the existing record
+    // Time complexity: O(1) expected in memory, O(log n) on disk; with
+    // indexing on, plus the amortized index update of one catch-up batch
+    void addRecord(const string& id, const string& record) {
+        store->put(id, record);
+        if (indexing == Indexing::None) return;
+        PendingShard& shard = pending[hash<string>{}(id) % PENDING_SHARDS];
+        {
+            lock_guard<mutex> guard(shard.lock);
+            shard.ids.push_back(id);
+        }
+        if (pendingCount.fetch_add(1, memory_order_acq_rel) + 1 >= CATCH_UP_BATCH) catchUp(false);
+    }
+
+    // Searches for a patient record by ID
+    // Returns the record if found, otherwise returns error message
+    // Time complexity: one lookup, one copy of the result
+    string searchRecord(const string& id) const {
+        string record;
+        return store->get(id, record) ? record : "Record not found";
+    }
+
+    // Shared handle to the stored record, or null if absent
+    // Zero-copy for the in-memory store (the handle keeps that version alive
+    // even if the record is updated later); other engines return a copy
+    RecordHandle findRecord(const string& id) const {
+        if (memory) return memory->get(id);
+        string record;
+        return store->get(id, record) ? make_shared<const string>(move(record)) : nullptr;
+    }
+
+    // Pins a consistent point-in-time view for reports: later addRecord
+    // calls are invisible to it and are not blocked by it
+    // In-memory engine only
+    RecordSnapshot snapshot() const {
+        if (!memory) throw runtime_error("snapshots need the in-memory record store");
+        return memory->snapshot();
+    }
+
+    // Superseded versions kept alive for pinned snapshots
+    size_t historyVersions() const { return memory ? memory->historyVersions() : 0; }
+
+    // Makes all records added so far durable (disk-backed engines)
+    void flush() { store->flush(); }
+
+    size_t recordCount() const { return store->size(); }
+
+    // Parses the stored record into name, visit and year; false if absent or unstructured
+    bool recordFields(const string& id, PatientFields& fields) const {
+        string record;
+        return store->get(id, record) && parsePatientRecord(record, fields);
+    }
+
+    // IDs in [from, to] in string order, e.g. recordsInRange("P1000100", "P1000199")
+    // IDs compare as strings, not numbers: with mixed-width IDs a range such
+    // as "P100".."P199" also returns P1000..P1999, so give both bounds the
+    // width of the IDs (or use recordsWithPrefix)
+    // Time complexity: O(log n + matches)
+    vector<string> recordsInRange(const string& from, const string& to) const {
+        const RecordIndex& ids = fieldIndex();
+        return collect([&](auto&& visit) { ids.scanIdRange(from, to, visit); });
+    }
+
+    // IDs starting with prefix in order
+    vector<string> recordsWithPrefix(const string& prefix) const {
+        const RecordIndex& ids = fieldIndex();
+        return collect([&](auto&& visit) { ids.scanIdPrefix(prefix, visit); });
+    }
+
+    // IDs of patients with this name (or names starting with it when prefix is set)
+    vector<string> patientsNamed(const string& name, bool prefix = false) const {
+        const RecordIndex& names = fieldIndex();
+        return collect([&](auto&& visit) { names.scanName(name, !prefix, visit); });
+    }
+
+    // IDs of records with a visit in year, e.g. all patients seen in 2023
+    vector<string> visitsInYear(int year) const { return visitsBetween(year, year); }
+
+    // IDs of records with a visit year in [from, to], by year
+    vector<string> visitsBetween(int from, int to) const {
+        const RecordIndex& years = fieldIndex();
+        return collect([&](auto&& visit) { years.scanYears(from, to, visit); });
+    }
+
+    // Visits every (id, record) pair in the store, in no particular order
+    void scanRecords(const function<void(const string&, const string&)>& visit) const { store->scan(visit); }
+
+    // Records containing every word of query ("surgery 2023"), best BM25 match first
+    vector<TextIndex::Hit> searchText(const string& query, size_t limit = 10) const {
+        return fullText().search(query, limit);
+    }
+
+    // Direct access to the indexes for streaming scans (no result vector),
+    // brought up to date with the records added so far
+    const RecordIndex& indexes() const { return fieldIndex(); }
+    const TextIndex& textIndex() const { return fullText(); }
+};
+
+// ============================
+// Helper: parallelFor (Dynamic Work Sharing)
+// ============================
+
+// Runs body(worker, index) for every index in [0, count) on `threads`
+// threads (worker in [0, threads)); indices are claimed dynamically so
+// uneven work items still balance
+template <class Body>
+void parallelFor(int count, int threads, Body&& body) {
+    atomic<int> next{0};
+    auto work = [&](int w) {
+        for (int i; (i = next.fetch_add(1, memory_order_relaxed)) < count;) body(w, i);
+    };
+    vector<thread> pool;
+    for (int w = 1; w < threads; ++w) pool.emplace_back(work, w);
+    work(0);
+    for (auto& t : pool) t.join();
+}
+
+// ============================
+// Class: ReferralSystem (Graph with Adjacency List)
+// ============================
+
+// Manages the doctor referral network using graph data structure
+// Implements Dijkstra's algorithm to find optimal referral paths
+// Doctor names are interned to dense integer ids on insertion; before the
+// first query the referrals are frozen into compressed sparse row (CSR)
+// adjacencies (forward and reverse), and every query reuses preallocated
+// workspaces, so repeated queries allocate nothing
+// Point-to-point queries stop as soon as the target is settled and can run
+// as plain Dijkstra, bidirectional Dijkstra, or ALT (A* with landmarks)
+class ReferralSystem {
+public:
+    static constexpr int INF = numeric_limits<int>::max();
+
+    enum class QueryMode {
+        Dijkstra,       // One search from the start, stops when the end is settled
+        Bidirectional,  // Forward search from start and backward search from end until they meet
+        Landmarks       // ALT: A* guided by triangle-inequality bounds from precomputed landmarks
+    };
+
+    enum class AllPairsMethod {
+        Auto,              // Pick by estimated work from the graph density
+        FloydWarshall,     // Blocked Floyd-Warshall, best for dense referral networks
+        RepeatedDijkstra   // One shortest-path tree per doctor, best for sparse ones
+    };
+
+    // Reusable Dijkstra state sized to the network
+    // Entries are valid only where stamp == epoch, so starting a new query
+    // is O(1): bump the epoch instead of clearing the arrays
+    struct Workspace {
+        vector<int> dist;            // Best known cost from the source
+        vector<int> prev;            // Previous doctor on that path (-1 at the source)
+        vector<uint32_t> stamp;      // Query epoch that last wrote dist/prev
+        uint32_t epoch = 0;
+        vector<pair<int, int>> heap; // Binary min-heap of (key, doctor), capacity kept between queries
+
+        // Start a new query over n doctors (grows the arrays only when the network grew)
+        void reset(int n) {
+            if ((int)stamp.size() < n) {
+                dist.resize(n);
+                prev.resize(n);
+                stamp.resize(n, 0);
+            }
+            if (++epoch == 0) {  // Epoch wrapped: clear stamps once every 2^32 queries
+                fill(stamp.begin(), stamp.end(), 0);
+                epoch = 1;
+            }
+            heap.clear();
+        }
+
+        int distanceTo(int v) const { return stamp[v] == epoch ? dist[v] : INF; }
+
+        void settle(int v, int d, int from) {
+            dist[v] = d;
+            prev[v] = from;
+            stamp[v] = epoch;
+        }
+
+        void push(int key, int v) {
+            heap.push_back({key, v});
+            push_heap(heap.begin(), heap.end(), greater<>());
+        }
+
+        pair<int, int> pop() {
+            pop_heap(heap.begin(), heap.end(), greater<>());
+            pair<int, int> top = heap.back();
+            heap.pop_back();
+            return top;
+        }
+
+        int topKey() const { return heap.empty() ? INF : heap.front().first; }
+    };
+
+private:
+    // CSR adjacency: arcs of doctor u are [offset[u], offset[u + 1])
+    struct Adjacency {
+        vector<int> offset;
+        vector<int> target;
+        vector<int> cost;
+    };
+
+    // Doctor name interning: name -> dense id and back
+    unordered_map<string, int> idOf;
+    vector<string> names;
+
+    // Dynamic adjacency, always current: outArcs[u] = (to, cost) and
+    // inArcs[v] = (from, cost), each in insertion order
+    vector<vector<pair<int, int>>> outArcs;
+    vector<vector<pair<int, int>>> inArcs;
+
+    // Frozen adjacencies, rebuilt by freeze() after referrals change
+    bool frozen = false;
+    Adjacency forward;   // from -> to
+    Adjacency backward;  // to -> from, for searches towards a target
+
+    // Landmark distances for ALT, stored node-major (k entries per doctor)
+    // so one potential evaluation touches two contiguous runs
+    int landmarkCount = 0;
+    bool landmarksStale = true;
+    vector<int> landmarks;
+    vector<int> fromLandmark;  // [v * k + i] = cost(landmark i -> v)
+    vector<int> toLandmark;    // [v * k + i] = cost(v -> landmark i)
+
+    // Per-thread state for parallel queries (batches, all-pairs rows, Yen
+    // spurs), kept between calls
+    struct QueryWorker {
+        Workspace ws;
+        vector<uint32_t> wanted;     // wanted[v] == mark: v is a target of the current source
+        vector<uint32_t> banned;     // banned[v] == mark: v may not be visited (Yen root doctors)
+        vector<uint32_t> bannedHop;  // bannedHop[v] == mark: the spur doctor may not refer to v
+        uint32_t mark = 0;
+        vector<int> paths;           // Paths found by this worker, concatenated
+        vector<int> pathCosts;       // Cost from the search source to each entry of paths
+
+        // Starts a new mark over n doctors, emptying every stamped set at once
+        void nextMark(int n) {
+            if ((int)wanted.size() < n) {
+                wanted.assign(n, 0);
+                banned.assign(n, 0);
+                bannedHop.assign(n, 0);
+                mark = 0;
+            }
+            if (++mark == 0) {
+                fill(wanted.begin(), wanted.end(), 0);
+                fill(banned.begin(), banned.end(), 0);
+                fill(bannedHop.begin(), bannedHop.end(), 0);
+                mark = 1;
+            }
+        }
+    };
+    vector<QueryWorker> queryWorkers;
+
+    // All-pairs table: row-major cost matrix (16-bit when every cost fits,
+    // else 32-bit) and a next-hop matrix for path reconstruction, both with
+    // rows padded to a multiple of the Floyd-Warshall block size
+    static constexpr int APSP_BLOCK = 64;
+    static constexpr uint16_t NO_HOP = 0xFFFF;
+    struct AllPairsTable {
+        bool ready = false;
+        bool narrow = false;        // cost16 in use (else cost32)
+        int stride = 0;
+        vector<uint16_t> cost16;    // 0xFFFF = unreachable
+        vector<uint32_t> cost32;    // 0xFFFFFFFF = unreachable
+        vector<uint16_t> next;      // First doctor after i on the way to j
+    };
+    AllPairsTable allPairs;
+
+    // Shortest-path tree kept current for a frequently queried source
+    struct CachedTree {
+        vector<int> dist;    // INF where unreachable
+        vector<int> parent;  // -1 at the source and at unreachable doctors
+    };
+    static constexpr int HOT_AFTER_QUERIES = 2;  // Queries before a source gets a tree
+    static constexpr int COLD_SOURCE_LIMIT = 4096;
+    int hotSourceLimit = 0;                      // Off by default: see setHotSourceLimit
+    unordered_map<int, CachedTree> hotTrees;
+    vector<uint8_t> sourceHits;                  // sourceHits[doctor]: queries without a tree
+    int coldSources = 0;                         // Doctors with sourceHits != 0
+
+    // Repair state shared by all cached trees
+    vector<uint32_t> affectedStamp;  // == affectedMark: doctor is in the subtree being repaired
+    uint32_t affectedMark = 0;
+    vector<int> affected;
+    vector<pair<int, int>> repairHeap;
+    AllPairsMethod allPairsMethod = AllPairsMethod::Auto;
+    int allPairsThreads = 0;
+
+    QueryMode queryMode = QueryMode::Bidirectional;
+    Workspace workspace;         // Forward search state for the query methods
+    Workspace reverseWorkspace;  // Backward search state for bidirectional queries
+    vector<int> pathBuffer;      // Reused by findFastestPath
+
+    int intern(const string& name) {
+        auto [it, inserted] = idOf.emplace(name, (int)names.size());
+        if (inserted) {
+            names.push_back(name);
+            outArcs.emplace_back();
+            inArcs.emplace_back();
+        }
+        return it->second;
+    }
+
+    // Flattens per-doctor arc lists into CSR
+    static void buildAdjacency(Adjacency& adj, const vector<vector<pair<int, int>>>& lists) {
+        int n = lists.size();
+        adj.offset.assign(n + 1, 0);
+        for (int u = 0; u < n; ++u) adj.offset[u + 1] = adj.offset[u] + lists[u].size();
+        adj.target.resize(adj.offset[n]);
+        adj.cost.resize(adj.offset[n]);
+        for (int u = 0, a = 0; u < n; ++u)
+            for (auto [v, c] : lists[u]) {
+                adj.target[a] = v;
+                adj.cost[a++] = c;
+            }
+    }
+
+    // Dijkstra from source over adj into ws; stops once target is settled
+    // (target = -1 computes the full shortest-path tree)
+    void runDijkstra(const Adjacency& adj, int source, int target, Workspace& ws) const {
+        runDijkstraUntil(adj, source, ws, [target](int u) { return u == target; });
+    }
+
+    // Dijkstra from source over adj into ws; done(u) is called as each doctor
+    // is settled and returning true stops the search
+    template <class Done>
+    void runDijkstraUntil(const Adjacency& adj, int source, Workspace& ws, Done&& done) const {
+        ws.reset(names.size());
+        ws.settle(source, 0, -1);
+        ws.push(0, source);
+        while (!ws.heap.empty()) {
+            auto [d, u] = ws.pop();
+            if (d > ws.distanceTo(u)) continue;  // Stale heap entry (lazy deletion)
+            if (done(u)) break;                  // Settled: its distance is final
+            for (int a = adj.offset[u]; a < adj.offset[u + 1]; ++a) {
+                int v = adj.target[a];
+                int nd = d + adj.cost[a];
+                if (nd < ws.distanceTo(v)) {
+                    ws.settle(v, nd, u);
+                    ws.push(nd, v);
+                }
+            }
+        }
+    }
+
+    // Expands the cheapest node of one side of a bidirectional search and
+    // records any improved meeting point with the other side
+    void bidirectionalStep(const Adjacency& adj, Workspace& ws, const Workspace& other,
+                           int& best, int& meet) const {
+        auto [d, u] = ws.pop();
+        if (d > ws.distanceTo(u)) return;
+        for (int a = adj.offset[u]; a < adj.offset[u + 1]; ++a) {
+            int v = adj.target[a];
+            int nd = d + adj.cost[a];
+            if (nd < ws.distanceTo(v)) {
+                ws.settle(v, nd, u);
+                ws.push(nd, v);
+            }
+            int back = other.distanceTo(v);
+            if (back != INF && ws.distanceTo(v) + back < best) {
+                best = ws.distanceTo(v) + back;
+                meet = v;
+            }
+        }
+    }
+
+    // Bidirectional Dijkstra: alternates the side with the smaller frontier key
+    // and stops once the two frontiers together cannot beat the best meeting
+    int bidirectionalSearch(int start, int end, vector<int>* path) {
+        workspace.reset(names.size());
+        reverseWorkspace.reset(names.size());
+        workspace.settle(start, 0, -1);
+        workspace.push(0, start);
+        reverseWorkspace.settle(end, 0, -1);
+        reverseWorkspace.push(0, end);
+        int best = start == end ? 0 : INF, meet = start;
+
+        while (!workspace.heap.empty() && !reverseWorkspace.heap.empty()) {
+            int f = workspace.topKey(), b = reverseWorkspace.topKey();
+            if (best != INF && f + b >= best) break;
+            if (f <= b) bidirectionalStep(forward, workspace, reverseWorkspace, best, meet);
+            else bidirectionalStep(backward, reverseWorkspace, workspace, best, meet);
+        }
+
+        if (path) {
+            path->clear();
+            if (best != INF) {
+                for (int at = meet; at != -1; at = workspace.prev[at]) path->push_back(at);
+                reverse(path->begin(), path->end());
+                // Backward prev pointers lead from the meeting point towards the end
+                for (int at = reverseWorkspace.prev[meet]; at != -1; at = reverseWorkspace.prev[at])
+                    path->push_back(at);
+            }
+        }
+        return best == INF ? -1 : best;
+    }
+
+    // Lower bound on cost(v -> t) from the triangle inequality over all landmarks:
+    //   cost(v, t) >= cost(L, t) - cost(L, v)   and   cost(v, t) >= cost(v, L) - cost(t, L)
+    int potential(int v, int t) const {
+        int k = landmarks.size(), h = 0;
+        const int* fv = &fromLandmark[(size_t)v * k];
+        const int* ft = &fromLandmark[(size_t)t * k];
+        const int* tv = &toLandmark[(size_t)v * k];
+        const int* tt = &toLandmark[(size_t)t * k];
+        for (int i = 0; i < k; ++i) {
+            if (ft[i] != INF && fv[i] != INF) h = max(h, ft[i] - fv[i]);
+            if (tv[i] != INF && tt[i] != INF) h = max(h, tv[i] - tt[i]);
+        }
+        return h;
+    }
+
+    // Chooses landmarks by farthest-point selection and stores their forward
+    // and backward distances to every doctor
+    // Time complexity: O(k (V + E) log V), space O(k V)
+    void buildLandmarks() {
+        int n = names.size(), k = min(landmarkCount, n);
+        landmarks.clear();
+        fromLandmark.assign((size_t)n * k, INF);
+        toLandmark.assign((size_t)n * k, INF);
+        vector<int> nearest(n, INF);  // Cost from the closest chosen landmark
+        vector<char> chosen(n, 0);    // Doctors already picked as landmarks
+
+        // Seed with the doctor farthest from doctor 0, then repeatedly take the
+        // reachable doctor whose nearest landmark is farthest away
+        runDijkstra(forward, 0, -1, workspace);
+        int next = 0;
+        for (int v = 0; v < n; ++v)
+            if (workspace.distanceTo(v) != INF && workspace.distanceTo(v) > workspace.distanceTo(next)) next = v;
+
+        for (int i = 0; i < k; ++i) {
+            landmarks.push_back(next);
+            chosen[next] = 1;
+            runDijkstra(forward, next, -1, workspace);
+            runDijkstra(backward, next, -1, reverseWorkspace);
+            for (int v = 0; v < n; ++v) {
+                fromLandmark[(size_t)v * k + i] = workspace.distanceTo(v);
+                toLandmark[(size_t)v * k + i] = reverseWorkspace.distanceTo(v);
+                int d = min(workspace.distanceTo(v), reverseWorkspace.distanceTo(v));
+                nearest[v] = min(nearest[v], d);
+            }
+            // Unreached doctors (nearest == INF) are preferred: they need a landmark most
+            // Doctors a zero-cost referral away from a landmark stay eligible
+            next = -1;
+            for (int v = 0; v < n; ++v)
+                if (!chosen[v] && (next == -1 || nearest[v] > nearest[next])) next = v;
+            if (next == -1) break;  // Every doctor is already a landmark
+        }
+        // Shrink the tables if fewer landmarks than requested were placed
+        if ((int)landmarks.size() < k) {
+            int used = landmarks.size();
+            for (int v = 0; v < n; ++v)
+                for (int i = 0; i < used; ++i) {
+                    fromLandmark[(size_t)v * used + i] = fromLandmark[(size_t)v * k + i];
+                    toLandmark[(size_t)v * used + i] = toLandmark[(size_t)v * k + i];
+                }
+            fromLandmark.resize((size_t)n * used);
+            toLandmark.resize((size_t)n * used);
+        }
+        landmarksStale = false;
+    }
+
+    // A* from start towards end with the landmark potential (ALT)
+    // The potential is consistent, so the end's distance is final when popped
+    int landmarkSearch(int start, int end, vector<int>* path) {
+        if (landmarksStale) buildLandmarks();
+        Workspace& ws = workspace;
+        ws.reset(names.size());
+        ws.settle(start, 0, -1);
+        ws.push(potential(start, end), start);
+        while (!ws.heap.empty()) {
+            auto [key, u] = ws.pop();
+            int d = ws.distanceTo(u);
+            if (key > d + potential(u, end)) continue;  // Stale heap entry
+            if (u == end) break;
+            for (int a = forward.offset[u]; a < forward.offset[u + 1]; ++a) {
+                int v = forward.target[a];
+                int nd = d + forward.cost[a];
+                if (nd < ws.distanceTo(v)) {
+                    ws.settle(v, nd, u);
+                    ws.push(nd + potential(v, end), v);
+                }
+            }
+        }
+        return extractPath(ws, end, path);
+    }
+
+    // One k-step of Floyd-Warshall on a row segment: d_i[j] = min(d_i[j], d_ik + d_k[j])
+    // Sums saturate at CAP so a 16-bit table can tell "too large to fit"
+    // (CAP) apart from "unreachable" (all ones). The 16-bit case has an SSE2
+    // path doing 8 doctors per step with saturating adds and blends
+    // di and dk are the same row when i == k (diagonal tile and pivot row
+    // panel), so neither is __restrict; row k is unchanged by its own pass
+    // because d[k][k] is 0, which makes the aliasing harmless
+    template <class T>
+    static void relaxRow(T* di, const T* dk, uint16_t* __restrict ni,
+                         T dik, uint16_t hop, int len) {
+        constexpr T UNREACHABLE = numeric_limits<T>::max(), CAP = UNREACHABLE - 1;
+        if (dik == UNREACHABLE) return;
+        int j = 0;
+#ifdef __SSE2__
+        if constexpr (is_same_v<T, uint16_t>) {
+            const __m128i vdik = _mm_set1_epi16((short)dik), vhop = _mm_set1_epi16((short)hop);
+            const __m128i cap = _mm_set1_epi16((short)CAP), ones = _mm_set1_epi16(-1), zero = _mm_setzero_si128();
+            for (; j + 8 <= len; j += 8) {
+                __m128i k = _mm_loadu_si128((const __m128i*)(dk + j));
+                __m128i cur = _mm_loadu_si128((const __m128i*)(di + j));
+                __m128i nxt = _mm_loadu_si128((const __m128i*)(ni + j));
+                __m128i sum = _mm_adds_epu16(vdik, k);
+                __m128i cand = _mm_sub_epi16(sum, _mm_subs_epu16(sum, cap));      // min(sum, CAP)
+                cand = _mm_or_si128(cand, _mm_cmpeq_epi16(k, ones));            // Keep UNREACHABLE
+                __m128i gain = _mm_subs_epu16(cur, cand);                        // cur - cand, or 0
+                __m128i better = _mm_andnot_si128(_mm_cmpeq_epi16(gain, zero), ones);
+                _mm_storeu_si128((__m128i*)(di + j), _mm_sub_epi16(cur, gain)); // min(cur, cand)
+                _mm_storeu_si128((__m128i*)(ni + j),
+                                 _mm_or_si128(_mm_andnot_si128(better, nxt), _mm_and_si128(better, vhop)));
+            }
+        }
+#endif
+        using Wide = conditional_t<sizeof(T) < 4, uint32_t, uint64_t>;
+        for (; j < len; ++j) {
+            T cand = dk[j] == UNREACHABLE ? UNREACHABLE : (T)min<Wide>((Wide)dik + dk[j], CAP);
+            if (cand < di[j]) {
+                di[j] = cand;
+                ni[j] = hop;
+            }
+        }
+    }
+
+    // Relaxes block (bi, bj) through every k of block bk (k outermost, so
+    // blocks that share rows or columns with bk stay correct)
+    template <class T>
+    static void relaxBlock(T* d, uint16_t* next, int stride, int bi, int bj, int bk) {
+        const int B = APSP_BLOCK;
+        for (int k = bk * B; k < (bk + 1) * B; ++k)
+            for (int i = bi * B; i < (bi + 1) * B; ++i)
+                relaxRow(d + (size_t)i * stride + bj * B, d + (size_t)k * stride + bj * B,
+                         next + (size_t)i * stride + bj * B, d[(size_t)i * stride + k],
+                         next[(size_t)i * stride + k], B);
+    }
+
+    // Cache-blocked Floyd-Warshall over a padded stride x stride matrix
+    // Per diagonal block: the block itself, then its row and column blocks,
+    // then all remaining blocks; the last two phases run in parallel
+    // Time complexity: O(V^3), in 64 x 64 tiles that stay in L1/L2
+    template <class T>
+    static void floydWarshallBlocked(vector<T>& d, vector<uint16_t>& next, int stride, int threads) {
+        int nb = stride / APSP_BLOCK;
+        for (int bk = 0; bk < nb; ++bk) {
+            relaxBlock(d.data(), next.data(), stride, bk, bk, bk);
+            parallelFor(2 * nb, threads, [&](int, int x) {
+                int b = x / 2;
+                if (b == bk) return;
+                if (x % 2) relaxBlock(d.data(), next.data(), stride, bk, b, bk);
+                else relaxBlock(d.data(), next.data(), stride, b, bk, bk);
+            });
+            parallelFor(nb, threads, [&](int, int bi) {
+                if (bi == bk) return;
+                for (int bj = 0; bj < nb; ++bj)
+                    if (bj != bk) relaxBlock(d.data(), next.data(), stride, bi, bj, bk);
+            });
+        }
+    }
+
+    // Fills a padded cost matrix with direct referral costs
+    template <class T>
+    void initAllPairs(vector<T>& d, vector<uint16_t>& next, int stride) const {
+        int n = names.size();
+        d.assign((size_t)stride * stride, numeric_limits<T>::max());
+        next.assign((size_t)stride * stride, NO_HOP);
+        for (int i = 0; i < n; ++i) {
+            d[(size_t)i * stride + i] = 0;
+            next[(size_t)i * stride + i] = i;
+        }
+        for (int u = 0; u < n; ++u)
+            for (int a = forward.offset[u]; a < forward.offset[u + 1]; ++a) {
+                size_t at = (size_t)u * stride + forward.target[a];
+                if ((T)forward.cost[a] < d[at]) {
+                    d[at] = forward.cost[a];
+                    next[at] = forward.target[a];
+                }
+            }
+    }
+
+    // All-pairs by one Dijkstra tree per doctor, in parallel; first hops are
+    // read off each tree by walking prev pointers (memoised in the next row)
+    void allPairsByDijkstra(vector<uint32_t>& d, vector<uint16_t>& next, int stride, int threads) {
+        int n = names.size();
+        d.assign((size_t)stride * stride, numeric_limits<uint32_t>::max());
+        next.assign((size_t)stride * stride, NO_HOP);
+        if ((int)queryWorkers.size() < threads) queryWorkers.resize(threads);
+        parallelFor(n, threads, [&](int w, int s) {
+            Workspace& ws = queryWorkers[w].ws;
+            runDijkstra(forward, s, -1, ws);
+            uint32_t* row = &d[(size_t)s * stride];
+            uint16_t* hop = &next[(size_t)s * stride];
+            hop[s] = s;
+            for (int v = 0; v < n; ++v) {
+                if (ws.distanceTo(v) == INF) continue;
+                row[v] = ws.distanceTo(v);
+                // Climb to the nearest doctor whose first hop is known, then fill back down
+                int top = v;
+                while (hop[top] == NO_HOP && ws.prev[top] != s) top = ws.prev[top];
+                uint16_t first = hop[top] == NO_HOP ? top : hop[top];
+                for (int at = v; hop[at] == NO_HOP; at = ws.prev[at]) hop[at] = first;
+            }
+        });
+    }
+
+    // A* from spur to end for Yen's algorithm, guided by toEnd(v), a
+    // consistent lower bound on cost-to-end in the unrestricted network
+    // (still valid once doctors and referrals are banned; INF only for
+    // doctors that can never reach end); banned doctors and banned first
+    // hops out of the spur are skipped via the worker's stamps
+    // Returns the spur cost, or -1 if end cannot be reached within limit
+    template <class Bound>
+    int spurSearch(int spur, int end, Bound&& toEnd, int limit, QueryWorker& worker) const {
+        Workspace& ws = worker.ws;
+        ws.reset(names.size());
+        ws.settle(spur, 0, -1);
+        ws.push(toEnd(spur), spur);
+        while (!ws.heap.empty()) {
+            auto [key, u] = ws.pop();
+            if (key > limit) break;  // No cheaper detour is left
+            int d = ws.distanceTo(u);
+            if (key > d + toEnd(u)) continue;  // Stale heap entry
+            if (u == end) return d;
+            for (int a = forward.offset[u]; a < forward.offset[u + 1]; ++a) {
+                int v = forward.target[a];
+                if (worker.banned[v] == worker.mark) continue;
+                if (u == spur && worker.bannedHop[v] == worker.mark) continue;
+                int nd = d + forward.cost[a];
+                if (nd < ws.distanceTo(v)) {
+                    int h = toEnd(v);
+                    if (h == INF) continue;
+                    ws.settle(v, nd, u);
+                    ws.push(nd + h, v);
+                }
+            }
+        }
+        return -1;
+    }
+
+    // Cost of the cheapest referral u -> v in the dynamic adjacency (INF if none)
+    int cheapestArc(int u, int v) const {
+        int best = INF;
+        for (auto [to, c] : outArcs[u])
+            if (to == v) best = min(best, c);
+        return best;
+    }
+
+    // Cached tree for source, building one once the source is hot enough
+    CachedTree* hotTree(int source) {
+        if (hotSourceLimit == 0) return nullptr;
+        auto it = hotTrees.find(source);
+        if (it == hotTrees.end()) {
+            if ((int)sourceHits.size() < (int)names.size()) sourceHits.resize(names.size(), 0);
+            if (sourceHits[source] == 0 && ++coldSources > COLD_SOURCE_LIMIT) {
+                fill(sourceHits.begin(), sourceHits.end(), 0);  // Forget cold sources
+                coldSources = 1;
+            }
+            if (sourceHits[source] < HOT_AFTER_QUERIES) sourceHits[source]++;
+            if (sourceHits[source] < HOT_AFTER_QUERIES || (int)hotTrees.size() >= hotSourceLimit) return nullptr;
+            sourceHits[source] = 0;
+            coldSources--;
+            freeze();
+            runDijkstra(forward, source, -1, workspace);
+            CachedTree& tree = hotTrees[source];
+            tree.dist.resize(names.size());
+            tree.parent.resize(names.size());
+            for (int v = 0; v < (int)names.size(); ++v) {
+                tree.dist[v] = workspace.distanceTo(v);
+                tree.parent[v] = tree.dist[v] == INF ? -1 : workspace.prev[v];
+            }
+            return &tree;
+        }
+        // Doctors added since the tree was built are unreachable until a referral says otherwise
+        it->second.dist.resize(names.size(), INF);
+        it->second.parent.resize(names.size(), -1);
+        return &it->second;
+    }
+
+    void pushRepair(int d, int v) {
+        repairHeap.push_back({d, v});
+        push_heap(repairHeap.begin(), repairHeap.end(), greater<>());
+    }
+
+    // Dijkstra over the dynamic adjacency from the doctors in repairHeap;
+    // with onlyAffected, relaxes only into the subtree being repaired
+    void propagateRepair(CachedTree& tree, bool onlyAffected) {
+        while (!repairHeap.empty()) {
+            pop_heap(repairHeap.begin(), repairHeap.end(), greater<>());
+            auto [d, x] = repairHeap.back();
+            repairHeap.pop_back();
+            if (d > tree.dist[x]) continue;
+            for (auto [y, c] : outArcs[x]) {
+                if (onlyAffected && affectedStamp[y] != affectedMark) continue;
+                if (d + c < tree.dist[y]) {
+                    tree.dist[y] = d + c;
+                    tree.parent[y] = x;
+                    pushRepair(d + c, y);
+                }
+            }
+        }
+    }
+
+    // Ramalingam-Reps style update of every cached tree after the cheapest
+    // referral u -> v went from `before` to `after` (INF = no referral)
+    // A cheaper referral propagates improvements outward from v; a dearer
+    // one that carried a tree edge re-resolves only v's subtree: its doctors
+    // take their best parent outside the subtree, then Dijkstra settles the
+    // rest inside it. Doctors outside the affected region keep their entries
+    void referralChanged(int u, int v, int before, int after) {
+        if (after == before || u == v) return;
+        for (auto& [source, tree] : hotTrees) {
+            tree.dist.resize(names.size(), INF);
+            tree.parent.resize(names.size(), -1);
+            if (after < before) {
+                if (tree.dist[u] == INF || tree.dist[u] + after >= tree.dist[v]) continue;
+                tree.dist[v] = tree.dist[u] + after;
+                tree.parent[v] = u;
+                pushRepair(tree.dist[v], v);
+                propagateRepair(tree, false);
+                continue;
+            }
+            if (tree.parent[v] != u) continue;  // Tree does not use the referral
+
+            // Collect v's subtree by following tree edges along out-arcs
+            if (affectedStamp.size() < names.size()) affectedStamp.resize(names.size(), 0);
+            if (++affectedMark == 0) {
+                fill(affectedStamp.begin(), affectedStamp.end(), 0);
+                affectedMark = 1;
+            }
+            affected.assign(1, v);
+            affectedStamp[v] = affectedMark;
+            for (size_t i = 0; i < affected.size(); ++i)
+                for (auto [y, c] : outArcs[affected[i]])
+                    if (tree.parent[y] == affected[i] && affectedStamp[y] != affectedMark) {
+                        affectedStamp[y] = affectedMark;
+                        affected.push_back(y);
+                    }
+
+            // Best entry into each affected doctor from outside the subtree
+            for (int y : affected) {
+                tree.dist[y] = INF;
+                tree.parent[y] = -1;
+                for (auto [x, c] : inArcs[y])
+                    if (affectedStamp[x] != affectedMark && tree.dist[x] != INF && tree.dist[x] + c < tree.dist[y]) {
+                        tree.dist[y] = tree.dist[x] + c;
+                        tree.parent[y] = x;
+                    }
+                if (tree.dist[y] != INF) pushRepair(tree.dist[y], y);
+            }
+            propagateRepair(tree, true);
+        }
+    }
+
+    // Reads the cost to end from a single-direction search and optionally its path
+    static int extractPath(const Workspace& ws, int end, vector<int>* path) {
+        int d = ws.distanceTo(end);
+        if (path) {
+            path->clear();
+            if (d != INF) {
+                for (int at = end; at != -1; at = ws.prev[at]) path->push_back(at);
+                reverse(path->begin(), path->end());
+            }
+        }
+        return d == INF ? -1 : d;
+    }
+
+public:
+    // Adds a referral relationship between two doctors
+    // 'from' doctor can refer patients to 'to' doctor with specified cost/time
+    void addReferral(const string& from, const string& to, int cost) {
+        int u = intern(from), v = intern(to);
+        int before = cheapestArc(u, v);
+        outArcs[u].push_back({v, cost});
+        inArcs[v].push_back({u, cost});
+        frozen = false;  // Adjacency is rebuilt before the next query
+        referralChanged(u, v, before, min(before, cost));
+    }
+
+    // Changes the cost of the referral from -> to (every parallel referral
+    // between the two doctors), e.g. when a doctor's availability changes;
+    // adds the referral if it does not exist yet
+    // Cached shortest-path trees are repaired incrementally
+    void updateReferralCost(const string& from, const string& to, int cost) {
+        int u = doctorId(from), v = doctorId(to);
+        int before = (u == -1 || v == -1) ? INF : cheapestArc(u, v);
+        if (before == INF) {
+            addReferral(from, to, cost);
+            return;
+        }
+        for (auto& arc : outArcs[u])
+            if (arc.first == v) arc.second = cost;
+        for (auto& arc : inArcs[v])
+            if (arc.first == u) arc.second = cost;
+        frozen = false;
+        referralChanged(u, v, before, cost);
+    }
+
+    // Caps how many hot source doctors keep an incrementally maintained
+    // shortest-path tree (0, the default, disables the cache)
+    // With the cache on, a source's second default-mode query runs a full
+    // single-source Dijkstra to build its tree, ignoring the query mode; it
+    // pays off for a few sources queried many times between updates
+    void setHotSourceLimit(int sources) {
+        hotSourceLimit = max(sources, 0);
+        while ((int)hotTrees.size() > hotSourceLimit) hotTrees.erase(hotTrees.begin());
+    }
+
+    int cachedSourceCount() const { return hotTrees.size(); }
+
+    // Builds the forward and reverse CSR adjacencies from the dynamic arc
+    // lists; called automatically by queries after referrals change, and
+    // invalidates the landmark and all-pairs tables
+    // Time complexity: O(V + E)
+    void freeze() {
+        if (frozen) return;
+        buildAdjacency(forward, outArcs);
+        buildAdjacency(backward, inArcs);
+        landmarksStale = true;
+        allPairs.ready = false;
+        frozen = true;
+    }
+
+    // Selects the point-to-point algorithm used by fastestPathCost/findFastestPath
+    void setQueryMode(QueryMode mode) { queryMode = mode; }
+
+    // Enables ALT queries with k landmarks; the tables are built lazily on
+    // the first ALT query after the network changes
+    void useLandmarks(int k) {
+        landmarkCount = max(k, 1);
+        landmarksStale = true;
+        queryMode = QueryMode::Landmarks;
+    }
+
+    int doctorCount() const { return names.size(); }
+
+    // Dense id of a doctor, or -1 if the doctor is not in the network
+    int doctorId(const string& name) const {
+        auto it = idOf.find(name);
+        return it == idOf.end() ? -1 : it->second;
+    }
+
+    const string& doctorName(int id) const { return names[id]; }
+
+    // Cheapest referral cost from start to end (ids), or -1 if unreachable
+    // If path is given, it receives the doctor ids along the route (start first)
+    // Uses the query mode set by setQueryMode / useLandmarks; allocation-free
+    // once the workspaces and path have grown to network size
+    // With setHotSourceLimit, sources queried repeatedly are answered from
+    // their cached tree in O(path) instead
+    int fastestPathCost(int start, int end, vector<int>* path = nullptr) {
+        if (CachedTree* tree = hotTree(start)) {
+            int d = tree->dist[end];
+            if (path) {
+                path->clear();
+                if (d != INF) {
+                    for (int at = end; at != -1; at = tree->parent[at]) path->push_back(at);
+                    reverse(path->begin(), path->end());
+                }
+            }
+            return d == INF ? -1 : d;
+        }
+        return fastestPathCost(start, end, path, queryMode);
+    }
+
+    int fastestPathCost(int start, int end, vector<int>* path, QueryMode mode) {
+        freeze();
+        if (mode == QueryMode::Bidirectional) return bidirectionalSearch(start, end, path);
+        if (mode == QueryMode::Landmarks && landmarkCount > 0) return landmarkSearch(start, end, path);
+        runDijkstra(forward, start, end, workspace);
+        return extractPath(workspace, end, path);
+    }
+
+    // A referral chain returned by kShortestPaths
+    struct ReferralChain {
+        int cost;
+        vector<int> doctors;
+    };
+
+    // Results of a batch query: cost[i] is the cost of query i (-1 if
+    // unreachable) and its path is nodes[offset[i], offset[i + 1])
+    struct BatchResult {
+        vector<int> cost;
+        vector<int> offset;
+        vector<int> nodes;
+    };
+
+    // Answers many (start, end) id queries at once
+    // Queries are grouped by start doctor; each group costs one Dijkstra run
+    // that stops when all of its targets are settled, and the groups are
+    // spread over threads that each own a workspace. Paths are collected per
+    // thread and copied into the flat result buffer at the end
+    // threads = 0 uses all hardware threads; withPaths = false fills only costs
+    void solveBatch(const vector<pair<int, int>>& queries, BatchResult& out,
+                    int threads = 0, bool withPaths = true) {
+        freeze();
+        int q = queries.size(), n = names.size();
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+
+        // Counting sort of query indices by start doctor
+        vector<int> groupStart(n + 1, 0), order(q);
+        for (const auto& query : queries) groupStart[query.first + 1]++;
+        for (int u = 0; u < n; ++u) groupStart[u + 1] += groupStart[u];
+        {
+            vector<int> cursor(groupStart.begin(), groupStart.end() - 1);
+            for (int i = 0; i < q; ++i) order[cursor[queries[i].first]++] = i;
+        }
+        vector<int> sources;
+        for (int u = 0; u < n; ++u)
+            if (groupStart[u + 1] > groupStart[u]) sources.push_back(u);
+
+        out.cost.assign(q, -1);
+        vector<int> pathWorker(withPaths ? q : 0), pathBegin(withPaths ? q : 0), pathLength(withPaths ? q : 0, 0);
+        threads = max(1, min<int>(threads, sources.size()));
+        if ((int)queryWorkers.size() < threads) queryWorkers.resize(threads);
 
-public:
-    // Adds a new patient record to the system
-    // If patient ID already exists, updates the existing record
-    // Time complexity: O(log n)
-    void addRecord(string id, string record) {
-        records[id] = record;
+        for (int w = 0; w < threads; ++w) queryWorkers[w].paths.clear();
+        parallelFor(sources.size(), threads, [&](int w, int g) {
+            QueryWorker& worker = queryWorkers[w];
+            int s = sources[g];
+            worker.nextMark(n);
+            int remaining = 0;
+            for (int k = groupStart[s]; k < groupStart[s + 1]; ++k) {
+                int t = queries[order[k]].second;
+                if (worker.wanted[t] != worker.mark) {
+                    worker.wanted[t] = worker.mark;
+                    remaining++;
+                }
+            }
+            runDijkstraUntil(forward, s, worker.ws, [&](int u) {
+                return worker.wanted[u] == worker.mark && --remaining == 0;
+            });
+
+            for (int k = groupStart[s]; k < groupStart[s + 1]; ++k) {
+                int i = order[k], t = queries[i].second;
+                int d = worker.ws.distanceTo(t);
+                if (d == INF) continue;
+                out.cost[i] = d;
+                if (!withPaths) continue;
+                pathWorker[i] = w;
+                pathBegin[i] = worker.paths.size();
+                for (int at = t; at != -1; at = worker.ws.prev[at]) worker.paths.push_back(at);
+                pathLength[i] = worker.paths.size() - pathBegin[i];
+                reverse(worker.paths.begin() + pathBegin[i], worker.paths.end());
+            }
+        });
+
+        // Lay the per-worker paths out in query order
+        out.offset.assign(q + 1, 0);
+        out.nodes.clear();
+        if (!withPaths) return;
+        for (int i = 0; i < q; ++i) out.offset[i + 1] = out.offset[i] + pathLength[i];
+        out.nodes.resize(out.offset[q]);
+        for (int i = 0; i < q; ++i)
+            if (pathLength[i] > 0)
+                copy_n(queryWorkers[pathWorker[i]].paths.begin() + pathBegin[i], pathLength[i],
+                       out.nodes.begin() + out.offset[i]);
     }
 
-    // Searches for a patient record by ID
-    // Returns the record if found, otherwise returns error message
-    // Time complexity: O(log n)
-    string searchRecord(string id) {
-        if (records.find(id) != records.end())
-            return records[id];
-        return "Record not found";
+    // Precomputes the referral cost between every pair of doctors so that
+    // allPairsCost/allPairsPath answer in O(1) per step
+    // Costs are kept 16-bit when every finite cost fits below 0xFFFE and
+    // 32-bit otherwise (the 16-bit Floyd-Warshall saturates, and is redone
+    // in 32 bits if anything saturated); the next-hop matrix is 16-bit, so
+    // this mode supports up to 65535 doctors
+    // Returns false if the network is too large
+    bool precomputeAllPairs(AllPairsMethod method = AllPairsMethod::Auto, int threads = 0) {
+        freeze();
+        int n = names.size();
+        if (n >= NO_HOP) return false;
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        allPairsMethod = method;
+        allPairsThreads = threads;
+
+        // Floyd-Warshall does V^3 vectorized relaxations, repeated Dijkstra
+        // ~V E log V heap steps; measured, one heap step costs about two relaxations
+        if (method == AllPairsMethod::Auto) {
+            double fw = (double)n * n * n / 2.0;
+            double dj = (double)n * (forward.target.size() + n) * max(1.0, log2((double)n));
+            method = fw < dj ? AllPairsMethod::FloydWarshall : AllPairsMethod::RepeatedDijkstra;
+        }
+
+        AllPairsTable& t = allPairs;
+        t.stride = (n + APSP_BLOCK - 1) / APSP_BLOCK * APSP_BLOCK;
+        t.narrow = false;
+        t.cost16.clear();
+        t.cost32.clear();
+        if (method == AllPairsMethod::FloydWarshall) {
+            int maxArc = 0;
+            for (int c : forward.cost) maxArc = max(maxArc, c);
+            if (maxArc < 0xFFFE) {
+                initAllPairs(t.cost16, t.next, t.stride);
+                floydWarshallBlocked(t.cost16, t.next, t.stride, threads);
+                t.narrow = true;
+                for (int i = 0; i < n && t.narrow; ++i)
+                    for (int j = 0; j < n; ++j)
+                        if (t.cost16[(size_t)i * t.stride + j] == 0xFFFE) {
+                            t.narrow = false;
+                            break;
+                        }
+                if (!t.narrow) t.cost16.clear();
+            }
+            if (!t.narrow) {
+                initAllPairs(t.cost32, t.next, t.stride);
+                floydWarshallBlocked(t.cost32, t.next, t.stride, threads);
+            }
+        } else {
+            allPairsByDijkstra(t.cost32, t.next, t.stride, threads);
+            uint32_t maxCost = 0;
+            for (uint32_t c : t.cost32)
+                if (c != numeric_limits<uint32_t>::max()) maxCost = max(maxCost, c);
+            if (maxCost < 0xFFFE) {
+                t.cost16.resize(t.cost32.size());
+                transform(t.cost32.begin(), t.cost32.end(), t.cost16.begin(),
+                          [](uint32_t c) { return (uint16_t)min<uint32_t>(c, 0xFFFF); });
+                vector<uint32_t>().swap(t.cost32);
+                t.narrow = true;
+            }
+        }
+        t.ready = true;
+        return true;
     }
-};
 
-// ============================
-// Class: ReferralSystem (Graph with Adjacency List)
-// ============================
+    // True if the all-pairs table uses 16-bit costs
+    bool allPairsNarrow() const { return allPairs.narrow; }
 
-// Manages the doctor referral network using graph data structure
-// Implements Dijkstra's algorithm to find optimal referral paths
-class ReferralSystem {
-private:
-    // Adjacency list representation of the referral network
-    // Key: doctor name, Value: vector of (referred_doctor, referral_cost) pairs
-    unordered_map<string, vector<pair<string, int>>> graph;
+    // Referral cost from start to end out of the all-pairs table, or -1 if
+    // unreachable (or not a doctor id); recomputes the table first if the
+    // network changed
+    int allPairsCost(int start, int end) {
+        int n = names.size();
+        if (start < 0 || start >= n || end < 0 || end >= n) return -1;
+        freeze();  // Clears allPairs.ready if referrals changed since the precompute
+        if (!allPairs.ready && !precomputeAllPairs(allPairsMethod, allPairsThreads)) return -1;
+        size_t at = (size_t)start * allPairs.stride + end;
+        if (allPairs.narrow) return allPairs.cost16[at] == 0xFFFF ? -1 : allPairs.cost16[at];
+        return allPairs.cost32[at] == numeric_limits<uint32_t>::max() ? -1 : (int)allPairs.cost32[at];
+    }
 
-public:
-    // Adds a referral relationship between two doctors
-    // 'from' doctor can refer patients to 'to' doctor with specified cost/time
-    void addReferral(string from, string to, int cost) {
-        graph[from].push_back({to, cost});
+    // Path from start to end by following the next-hop matrix (empty if unreachable)
+    void allPairsPath(int start, int end, vector<int>& path) {
+        path.clear();
+        if (allPairsCost(start, end) == -1) return;
+        for (int at = start; at != end; at = allPairs.next[(size_t)at * allPairs.stride + end])
+            path.push_back(at);
+        path.push_back(end);
     }
 
-    // Finds the fastest/cheapest referral path between two doctors using Dijkstra's algorithm
-    // Useful for determining optimal patient referral chains in complex hospital networks
-    void findFastestPath(string start, string end) {
-        // Distance map: shortest distance from start to each doctor
-        unordered_map<string, int> dist;
-        // Previous node map: used for reconstructing the optimal path
-        unordered_map<string, string> prev;
-        // Priority queue: (distance, doctor) pairs ordered by distance
-        set<pair<int, string>> pq;
+    // Yen's algorithm: up to k cheapest loopless referral chains from start
+    // to end, cheapest first
+    // One reverse search from end gives the best chain and an A* potential
+    // for the spur searches; then for each accepted chain, every prefix is tried as a
+    // root: its doctors are banned, as are the next hops taken by accepted
+    // chains sharing that root, and a spur search finds the cheapest detour.
+    // Spurs of one chain run in parallel on per-thread workspaces and stamps
+    // Two cuts keep the spur searches few and short:
+    // - Lawler's rule: a chain that left its parent at doctor j shares the
+    //   parent's roots before j, whose detours are already candidates, so
+    //   only roots from j on are tried
+    // - once the pool holds enough candidates for the remaining chains, a
+    //   spur search stops at the cost of the last one that could be taken
+    // With landmarks (useLandmarks) the reverse search is itself an A*
+    // towards start, so it only settles a corridor around the cheap chains
+    // Time complexity: O(k L) spur searches for chains of length L
+    vector<ReferralChain> kShortestPaths(int start, int end, int k, int threads = 0) {
+        freeze();
+        int n = names.size();
+        vector<ReferralChain> found;
+        if (k <= 0) return found;
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        if (landmarkCount > 0 && landmarksStale) buildLandmarks();
+        bool guided = landmarkCount > 0;
+
+        // Reverse A* from end with fromStart(v), a consistent lower bound on
+        // cost(start -> v) (0 without landmarks, i.e. plain Dijkstra). It
+        // stops at the first key 1/16 past the start's cost; then every
+        // unsettled doctor v has cost(v -> end) >= limit - fromStart(v), and
+        // min(reverse distance, limit - fromStart(v)) is a consistent bound
+        // for the spur searches (exact on the settled corridor)
+        Workspace& rev = reverseWorkspace;
+        auto fromStart = [&](int v) { return guided ? potential(start, v) : 0; };
+        rev.reset(n);
+        rev.settle(end, 0, -1);
+        rev.push(fromStart(end), end);
+        int radius = INF, limit = INF;
+        while (!rev.heap.empty()) {
+            auto [key, u] = rev.pop();
+            if (key > radius) {
+                limit = key;
+                break;
+            }
+            int d = rev.distanceTo(u);
+            if (key > d + fromStart(u)) continue;  // Stale heap entry
+            if (u == start) radius = d + d / 16;
+            for (int a = backward.offset[u]; a < backward.offset[u + 1]; ++a) {
+                int v = backward.target[a];
+                int nd = d + backward.cost[a];
+                if (nd < rev.distanceTo(v)) {
+                    rev.settle(v, nd, u);
+                    rev.push(nd + fromStart(v), v);
+                }
+            }
+        }
+        if (rev.distanceTo(start) == INF) return found;
+        auto toEnd = [&](int v) {
+            int d = rev.distanceTo(v);
+            if (limit == INF) return d;  // Every doctor that can reach end was settled
+            int h = min(d, limit - fromStart(v));
+            // The landmark bound on cost(v -> end) is consistent too; the max of the two is tighter
+            return guided ? max(h, potential(v, end)) : h;
+        };
+
+        // Best chain: follow the reverse tree from start; prefix[i] = cost up to doctors[i]
+        int best = rev.distanceTo(start);
+        vector<vector<int>> prefixes(1);
+        vector<int> deviations = {0};  // Doctor at which each chain left its parent
+        found.push_back({best, {}});
+        for (int at = start; at != -1; at = rev.prev[at]) {
+            found[0].doctors.push_back(at);
+            prefixes[0].push_back(best - rev.distanceTo(at));
+        }
+
+        // Candidates keyed by (cost, doctors), holding their prefix costs and deviation
+        map<pair<int, vector<int>>, pair<vector<int>, int>> candidates;
+        vector<int> spurCost, spurWorker, spurBegin, spurLength;
+        if ((int)queryWorkers.size() < threads) queryWorkers.resize(threads);
 
-        // Initialize all distances to infinity
-        for (auto& p : graph)
-            dist[p.first] = numeric_limits<int>::max();
+        while ((int)found.size() < k) {
+            const vector<int>& chain = found.back().doctors;
+            const vector<int>& prefix = prefixes.back();
+            int spurs = chain.size() - 1, first = deviations.back();
+            spurCost.assign(spurs, -1);
+            spurWorker.resize(spurs);
+            spurBegin.resize(spurs);
+            spurLength.resize(spurs);
+            for (int w = 0; w < threads; ++w) {
+                queryWorkers[w].paths.clear();
+                queryWorkers[w].pathCosts.clear();
+            }
+            // Only the `needed` cheapest candidates can still be taken
+            size_t needed = k - found.size();
+            int worst = INF;
+            if (candidates.size() >= needed) worst = next(candidates.begin(), needed - 1)->first.first;
 
-        // Set starting doctor distance to 0 and add to priority queue
-        dist[start] = 0;
-        pq.insert({0, start});
+            parallelFor(spurs - first, threads, [&](int w, int at) {
+                int i = first + at;
+                QueryWorker& worker = queryWorkers[w];
+                worker.nextMark(n);
+                for (int j = 0; j < i; ++j) worker.banned[chain[j]] = worker.mark;
+                for (const auto& accepted : found)
+                    if ((int)accepted.doctors.size() > i + 1 &&
+                        equal(chain.begin(), chain.begin() + i + 1, accepted.doctors.begin()))
+                        worker.bannedHop[accepted.doctors[i + 1]] = worker.mark;
 
-        // Main Dijkstra's algorithm loop
-        while (!pq.empty()) {
-            auto [d, u] = *pq.begin();  // Extract doctor with minimum distance
-            pq.erase(pq.begin());
+                int cost = spurSearch(chain[i], end, toEnd, worst == INF ? INF : worst - prefix[i], worker);
+                if (cost == -1) return;
+                spurCost[i] = cost;
+                spurWorker[i] = w;
+                spurBegin[i] = worker.paths.size();
+                for (int at = end; at != -1; at = worker.ws.prev[at]) {
+                    worker.paths.push_back(at);
+                    worker.pathCosts.push_back(worker.ws.distanceTo(at));
+                }
+                spurLength[i] = worker.paths.size() - spurBegin[i];
+                reverse(worker.paths.begin() + spurBegin[i], worker.paths.end());
+                reverse(worker.pathCosts.begin() + spurBegin[i], worker.pathCosts.end());
+            });
 
-            // Examine all doctors that current doctor can refer to
-            for (auto& [v, cost] : graph[u]) {
-                // If we found a shorter path to doctor v through u
-                if (dist[v] > dist[u] + cost) {
-                    pq.erase({dist[v], v});     // Remove old distance entry
-                    dist[v] = dist[u] + cost;   // Update with shorter distance
-                    prev[v] = u;                // Record path for reconstruction
-                    pq.insert({dist[v], v});    // Insert updated distance
+            // Root + spur for every successful spur becomes a candidate
+            for (int i = first; i < spurs; ++i) {
+                if (spurCost[i] == -1) continue;
+                const QueryWorker& worker = queryWorkers[spurWorker[i]];
+                vector<int> doctors(chain.begin(), chain.begin() + i);
+                vector<int> costs(prefix.begin(), prefix.begin() + i);
+                for (int j = spurBegin[i]; j < spurBegin[i] + spurLength[i]; ++j) {
+                    doctors.push_back(worker.paths[j]);
+                    costs.push_back(prefix[i] + worker.pathCosts[j]);
                 }
+                candidates.emplace(make_pair(prefix[i] + spurCost[i], move(doctors)), make_pair(move(costs), i));
             }
+            if (candidates.empty()) break;
+
+            auto cheapest = candidates.begin();
+            found.push_back({cheapest->first.first, cheapest->first.second});
+            prefixes.push_back(move(cheapest->second.first));
+            deviations.push_back(cheapest->second.second);
+            candidates.erase(cheapest);
         }
+        return found;
+    }
 
-        // Check if destination doctor is reachable
-        if (dist[end] == numeric_limits<int>::max()) {
+    // Prints up to k alternative referral chains between two doctors, cheapest first
+    void findAlternativePaths(const string& start, const string& end, int k) {
+        int s = doctorId(start), t = doctorId(end);
+        vector<ReferralChain> chains;
+        if (s != -1 && t != -1) chains = kShortestPaths(s, t, k);
+        if (chains.empty()) {
             cout << "No path found.\n";
             return;
         }
+        for (size_t i = 0; i < chains.size(); ++i) {
+            cout << "Referral option " << i + 1 << " (cost = " << chains[i].cost << "): ";
+            for (int doc : chains[i].doctors) cout << names[doc] << " ";
+            cout << endl;
+        }
+    }
 
-        // Reconstruct and display the optimal referral path
-        vector<string> path;
-        for (string at = end; at != ""; at = prev[at])
-            path.push_back(at);
+    // Finds the fastest/cheapest referral path between two doctors using Dijkstra's algorithm
+    // Useful for determining optimal patient referral chains in complex hospital networks
+    void findFastestPath(const string& start, const string& end) {
+        int s = doctorId(start), t = doctorId(end);
+        int cost = (s == -1 || t == -1) ? -1 : fastestPathCost(s, t, &pathBuffer);
+
+        // Check if destination doctor is reachable
+        if (cost == -1) {
+            cout << "No path found.\n";
+            return;
+        }
 
-        reverse(path.begin(), path.end());
-        cout << "Fastest referral path (cost = " << dist[end] << "): ";
-        for (auto& doc : path) cout << doc << " ";
+        // Display the optimal referral path
+        cout << "Fastest referral path (cost = " << cost << "): ";
+        for (int doc : pathBuffer) cout << names[doc] << " ";
         cout << endl;
     }
 };
 
+#ifdef HOSPITAL_HAS_COROUTINES
+// ============================
+// Helper: Generator (C++20 Coroutine)
+// ============================
+
+// Minimal lazy sequence: the coroutine runs only as far as the next co_yield
+// each time the consumer advances, so consumers can stop at any point
+// The coroutine frame is allocated once per generator, not per element
+template <class T>
+class Generator {
+public:
+    struct promise_type {
+        T current;
+
+        Generator get_return_object() { return Generator(handle::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        suspend_always yield_value(T value) noexcept {
+            current = value;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+    using handle = coroutine_handle<promise_type>;
+
+    struct iterator {
+        handle h;
+        iterator& operator++() {
+            h.resume();
+            return *this;
+        }
+        const T& operator*() const { return h.promise().current; }
+        bool operator==(default_sentinel_t) const { return h.done(); }
+    };
+
+    explicit Generator(handle h) : h(h) {}
+    Generator(Generator&& other) noexcept : h(exchange(other.h, {})) {}
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+    ~Generator() {
+        if (h) h.destroy();
+    }
+
+    iterator begin() {
+        h.resume();  // Run to the first co_yield
+        return {h};
+    }
+    default_sentinel_t end() const { return {}; }
+
+private:
+    handle h;
+};
+#endif
+
 // ============================
 // Class: TreatmentPlanner (DFS for Combinations)
 // ============================
 
 // Analyzes different treatment combinations using Depth-First Search
 // Generates all possible subsets of available treatments for comprehensive planning
+// Treatments can also be interned to dense ids and enumerated as bitmask
+// subsets in Gray-code order, split across threads, for callers that score
+// combinations instead of printing them
+// With costs, benefits, durations, covered conditions and incompatibilities
+// attached, a branch-and-bound optimizer finds the best feasible plan
 class TreatmentPlanner {
 public:
+    // Limits for optimizePlan
+    struct PlanConstraints {
+        long long budget = numeric_limits<long long>::max();       // Max total cost
+        long long maxDuration = numeric_limits<long long>::max();  // Max total duration
+        uint64_t requiredCoverage = 0;  // Conditions (bits) the plan must cover
+    };
+
+    // Result of optimizePlan
+    struct TreatmentPlan {
+        bool feasible = false;
+        long long benefit = 0, cost = 0, duration = 0;
+        uint64_t mask = 0;  // Bit i = treatment i
+        vector<string> treatments;
+    };
+
+private:
+    // Treatment interning: name -> dense id and back
+    unordered_map<string, int> treatmentIdOf;
+    vector<string> treatmentNames;
+
+    // Per-treatment attributes, indexed by id
+    vector<long long> treatmentCost, treatmentBenefit, treatmentDuration;
+    vector<uint64_t> treatmentCovers;    // Conditions each treatment covers
+    vector<uint64_t> treatmentConflicts; // Treatments it cannot be combined with
+
+    // State shared by the branch-and-bound workers
+    struct PlanSearch {
+        PlanConstraints limits;
+        vector<int> order;                 // Treatment ids by benefit/cost ratio, best first
+        atomic<long long> bestBenefit{-1}; // Incumbent, read lock-free for pruning
+        mutex bestLock;
+        TreatmentPlan best;
+    };
+
+    // A search node: decisions made for order[0, pos)
+    struct PlanNode {
+        int pos;
+        uint64_t mask, blocked, covered;  // Chosen, ruled out by conflicts, conditions covered
+        long long cost, duration, benefit;
+    };
+
+    void offerPlan(PlanSearch& search, const PlanNode& node) const {
+        if (node.benefit <= search.bestBenefit.load(memory_order_relaxed)) return;
+        lock_guard<mutex> lock(search.bestLock);
+        if (node.benefit <= search.best.benefit && search.best.feasible) return;
+        search.best.feasible = true;
+        search.best.benefit = node.benefit;
+        search.best.cost = node.cost;
+        search.best.duration = node.duration;
+        search.best.mask = node.mask;
+        search.bestBenefit.store(node.benefit, memory_order_relaxed);
+    }
+
+    // Upper bound on the benefit reachable below node: its benefit plus the
+    // fractional knapsack relaxation of the remaining, unblocked treatments
+    // under the remaining budget (durations, conflicts and coverage relaxed)
+    // Returns -1 if the required coverage is out of reach even taking all of them
+    double planBound(const PlanSearch& search, const PlanNode& node) const {
+        double bound = node.benefit;
+        long long room = search.limits.budget - node.cost;
+        uint64_t reach = node.covered;
+        for (size_t k = node.pos; k < search.order.size(); ++k) {
+            int id = search.order[k];
+            if (node.blocked >> id & 1) continue;
+            reach |= treatmentCovers[id];
+            if (treatmentCost[id] <= 0) {  // Free treatments fit under any budget
+                bound += treatmentBenefit[id];
+                room -= treatmentCost[id];
+                continue;
+            }
+            if (room <= 0) continue;
+            if (treatmentCost[id] <= room) {
+                bound += treatmentBenefit[id];
+                room -= treatmentCost[id];
+            } else {
+                bound += (double)treatmentBenefit[id] * room / treatmentCost[id];
+                room = 0;
+            }
+        }
+        uint64_t required = search.limits.requiredCoverage;
+        return (reach & required) == required ? bound : -1;
+    }
+
+    // Child of node with order[node.pos] taken (take = true) or skipped;
+    // returns false if taking it breaks a constraint
+    bool planChild(const PlanSearch& search, const PlanNode& node, bool take, PlanNode& child) const {
+        child = node;
+        child.pos++;
+        if (!take) return true;
+        int id = search.order[node.pos];
+        if (node.blocked >> id & 1) return false;
+        if (node.cost + treatmentCost[id] > search.limits.budget) return false;
+        if (node.duration + treatmentDuration[id] > search.limits.maxDuration) return false;
+        child.mask |= uint64_t(1) << id;
+        child.blocked |= treatmentConflicts[id];
+        child.covered |= treatmentCovers[id];
+        child.cost += treatmentCost[id];
+        child.duration += treatmentDuration[id];
+        child.benefit += treatmentBenefit[id];
+        return true;
+    }
+
+    // Depth-first branch and bound below node (take before skip, so good
+    // incumbents appear early and tighten pruning for every worker)
+    void branchAndBound(PlanSearch& search, const PlanNode& node) const {
+        uint64_t required = search.limits.requiredCoverage;
+        if ((node.covered & required) == required) offerPlan(search, node);
+        if (node.pos == (int)search.order.size()) return;
+        double bound = planBound(search, node);
+        if (bound < 0 || (long long)floor(bound + 1e-9) <= search.bestBenefit.load(memory_order_relaxed)) return;
+        PlanNode child;
+        if (planChild(search, node, true, child)) branchAndBound(search, child);
+        planChild(search, node, false, child);
+        branchAndBound(search, child);
+    }
+
+public:
+    static constexpr int MAX_TREATMENTS = 63;  // Subsets are uint64_t masks
+
+    // Registers a treatment and returns its id (existing names keep their id)
+    int addTreatment(const string& name) {
+        auto [it, inserted] = treatmentIdOf.emplace(name, (int)treatmentNames.size());
+        if (inserted) {
+            treatmentNames.push_back(name);
+            treatmentCost.push_back(0);
+            treatmentBenefit.push_back(0);
+            treatmentDuration.push_back(0);
+            treatmentCovers.push_back(0);
+            treatmentConflicts.push_back(0);
+        }
+        return it->second;
+    }
+
+    // Registers (or updates) a treatment with its planning attributes
+    // covers: bitmask of conditions the treatment addresses
+    int addTreatment(const string& name, long long cost, long long benefit, long long duration = 0,
+                     uint64_t covers = 0) {
+        int id = addTreatment(name);
+        treatmentCost[id] = cost;
+        treatmentBenefit[id] = benefit;
+        treatmentDuration[id] = duration;
+        treatmentCovers[id] = covers;
+        return id;
+    }
+
+    // Marks two treatments as contraindicated (never in the same plan)
+    void addIncompatibility(const string& a, const string& b) {
+        int x = addTreatment(a), y = addTreatment(b);
+        if (x >= 64 || y >= 64) return;
+        treatmentConflicts[x] |= uint64_t(1) << y;
+        treatmentConflicts[y] |= uint64_t(1) << x;
+    }
+
+    // Finds the plan with the greatest total benefit within the budget and
+    // duration limit, covering the required conditions, with no two
+    // incompatible treatments (benefits are assumed non-negative)
+    // Branch and bound over treatments in benefit/cost order, pruned by the
+    // fractional knapsack bound, coverage reachability and conflict masks.
+    // The first levels are expanded into subtrees that threads search in
+    // parallel, sharing the incumbent through an atomic
+    // threads = 0 uses all hardware threads
+    TreatmentPlan optimizePlan(const PlanConstraints& limits, int threads = 0) const {
+        int n = treatmentNames.size();
+        if (n > MAX_TREATMENTS) return {};
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        PlanSearch search;
+        search.limits = limits;
+        search.order.resize(n);
+        for (int i = 0; i < n; ++i) search.order[i] = i;
+        vector<double> ratio(n);
+        for (int i = 0; i < n; ++i)  // Free treatments with any benefit go first
+            ratio[i] = treatmentCost[i] > 0 ? (double)treatmentBenefit[i] / treatmentCost[i]
+                                            : (treatmentBenefit[i] > 0 ? HUGE_VAL : 0.0);
+        stable_sort(search.order.begin(), search.order.end(), [&](int a, int b) { return ratio[a] > ratio[b]; });
+
+        // Expand the top levels breadth-first into enough subtrees to keep every thread busy
+        vector<PlanNode> frontier{{0, 0, 0, 0, 0, 0, 0}}, next;
+        uint64_t required = limits.requiredCoverage;
+        while ((int)frontier.size() < threads * 32 && frontier[0].pos < n) {
+            next.clear();
+            for (const PlanNode& node : frontier) {
+                if ((node.covered & required) == required) offerPlan(search, node);
+                PlanNode child;
+                for (bool take : {true, false})
+                    if (planChild(search, node, take, child) && planBound(search, child) >= 0) next.push_back(child);
+            }
+            frontier.swap(next);
+            if (frontier.empty()) break;
+        }
+        // Most promising subtrees first
+        sort(frontier.begin(), frontier.end(), [&](const PlanNode& a, const PlanNode& b) {
+            return planBound(search, a) > planBound(search, b);
+        });
+        parallelFor(frontier.size(), threads, [&](int, int i) { branchAndBound(search, frontier[i]); });
+
+        TreatmentPlan plan = move(search.best);
+        for (int i = 0; i < n; ++i)
+            if (plan.mask >> i & 1) plan.treatments.push_back(treatmentNames[i]);
+        return plan;
+    }
+
+    // Prints the optimal plan for the given limits
+    void recommendPlan(const PlanConstraints& limits) const {
+        TreatmentPlan plan = optimizePlan(limits);
+        if (!plan.feasible) {
+            cout << "No feasible treatment plan.\n";
+            return;
+        }
+        cout << "Best treatment plan (benefit = " << plan.benefit << ", cost = " << plan.cost << "): ";
+        for (const auto& t : plan.treatments) cout << t << " ";
+        cout << endl;
+    }
+
+    int treatmentCount() const { return treatmentNames.size(); }
+    const string& treatmentName(int id) const { return treatmentNames[id]; }
+
+    // Visits every subset of the registered treatments as a bitmask (bit i =
+    // treatment i) in Gray-code order, so consecutive subsets differ by one
+    // treatment: visit(worker, mask, changed) gets the id toggled since the
+    // worker's previous subset, or -1 at the start of a chunk (recompute any
+    // running totals from the mask). The 2^n range is cut into chunks that
+    // threads claim dynamically; each worker sees its chunks in order
+    // threads = 0 uses all hardware threads
+    // Time complexity: O(2^n) visits, O(1) work per step
+    template <class Visitor>
+    void enumerateSubsets(Visitor&& visit, int threads = 0) const {
+        int n = treatmentNames.size();
+        if (n > MAX_TREATMENTS) return;
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        uint64_t total = uint64_t(1) << n;
+        int chunks = (int)min<uint64_t>(total, (uint64_t)threads * 16);
+        parallelFor(chunks, threads, [&](int w, int c) {
+            uint64_t lo = total / chunks * c + min<uint64_t>(c, total % chunks);
+            uint64_t hi = lo + total / chunks + ((uint64_t)c < total % chunks ? 1 : 0);
+            uint64_t mask = lo ^ (lo >> 1);  // Gray code of lo
+            visit(w, mask, -1);
+            for (uint64_t i = lo + 1; i < hi; ++i) {
+                int changed = __builtin_ctzll(i);  // Gray(i) = Gray(i - 1) with this bit flipped
+                mask ^= uint64_t(1) << changed;
+                visit(w, mask, changed);
+            }
+        });
+    }
+
+#ifdef HOSPITAL_HAS_COROUTINES
+    // Lazily yields every combination of the registered treatments, in the
+    // same order as dfsCombinations, as a span of treatment ids over one
+    // reused buffer (valid until the consumer advances; copy to keep it)
+    // Nothing is materialized and nothing is allocated per combination, so
+    // consumers can take the first N, filter, or stream into scoring
+    Generator<span<const int>> combinations() const {
+        int n = treatmentNames.size();
+        vector<int> buffer(n);
+        for (int i = 0; i < n; ++i) buffer[i] = i;
+        co_yield span<const int>(buffer.data(), buffer.size());
+        // Next in include-first DFS order: drop the last treatment taken and
+        // take every treatment after it (amortized O(1) per combination)
+        while (!buffer.empty()) {
+            int last = buffer.back();
+            buffer.pop_back();
+            for (int i = last + 1; i < n; ++i) buffer.push_back(i);
+            co_yield span<const int>(buffer.data(), buffer.size());
+        }
+    }
+#endif
+
     // Generates all possible combinations of treatments using recursive DFS
     // Implements powerset algorithm to explore all treatment possibilities
     // Parameters:
@@ -202,11 +3686,741 @@ public:
     }
 };
 
+// ============================
+// Benchmark: Referral Queries
+// ============================
+
+// Builds a multi-hospital referral network as a side x side grid of doctors
+// (referrals to the four neighbours in both directions, random costs) plus a
+// sprinkling of long-range inter-hospital referrals
+ReferralSystem buildReferralGrid(int side, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> cost(1, 100), node(0, side * side - 1);
+    vector<string> doctor(side * side);
+    for (int i = 0; i < side * side; ++i) doctor[i] = "Dr. " + to_string(i);
+
+    ReferralSystem rs;
+    for (int r = 0; r < side; ++r)
+        for (int c = 0; c < side; ++c) {
+            int u = r * side + c;
+            if (c + 1 < side) {
+                rs.addReferral(doctor[u], doctor[u + 1], cost(rng));
+                rs.addReferral(doctor[u + 1], doctor[u], cost(rng));
+            }
+            if (r + 1 < side) {
+                rs.addReferral(doctor[u], doctor[u + side], cost(rng));
+                rs.addReferral(doctor[u + side], doctor[u], cost(rng));
+            }
+        }
+    for (int i = 0; i < side * side / 100; ++i) rs.addReferral(doctor[node(rng)], doctor[node(rng)], 500 + cost(rng) * 20);
+    rs.freeze();
+    return rs;
+}
+
+// Times random point-to-point queries in each query mode and checks that
+// all modes agree on the cost (run with: ./hospital --bench-referrals [side])
+void runReferralQueryBenchmark(int side) {
+    using Clock = chrono::steady_clock;
+    const int queries = 200;
+    ReferralSystem rs = buildReferralGrid(side, 11);
+    mt19937 rng(5);
+    uniform_int_distribution<int> node(0, rs.doctorCount() - 1);
+    vector<pair<int, int>> pairs(queries);
+    for (auto& q : pairs) q = {node(rng), node(rng)};
+
+    auto start = Clock::now();
+    rs.useLandmarks(16);
+    rs.fastestPathCost(0, 0);  // Builds the landmark tables
+    double landmarkMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    cout << "Referral query benchmark: " << rs.doctorCount() << " doctors, " << queries << " queries\n";
+    cout << "Landmark precompute (16): " << landmarkMs << " ms\n";
+
+    using Mode = ReferralSystem::QueryMode;
+    vector<int> reference(queries), path;
+    for (auto [mode, label] : {pair<Mode, const char*>{Mode::Dijkstra, "Dijkstra (early exit)"},
+                               {Mode::Bidirectional, "Bidirectional"},
+                               {Mode::Landmarks, "ALT (landmarks)"}}) {
+        int mismatches = 0;
+        auto begin = Clock::now();
+        for (int i = 0; i < queries; ++i) {
+            int cost = rs.fastestPathCost(pairs[i].first, pairs[i].second, &path, mode);
+            if (mode == Mode::Dijkstra) reference[i] = cost;
+            else if (cost != reference[i]) mismatches++;
+        }
+        double ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+        cout << label << ": " << ms / queries << " ms/query";
+        if (mismatches) cout << "  (" << mismatches << " COST MISMATCHES)";
+        cout << "\n";
+    }
+
+    // The default overload (mode from useLandmarks, no tree cache), with
+    // every pair queried twice so a cache would have kicked in
+    {
+        int mismatches = 0;
+        auto begin = Clock::now();
+        for (int repeat = 0; repeat < 2; ++repeat)
+            for (int i = 0; i < queries; ++i) mismatches += rs.fastestPathCost(pairs[i].first, pairs[i].second, &path) != reference[i];
+        double ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+        cout << "Default mode: " << ms / (2 * queries) << " ms/query";
+        if (mismatches) cout << "  (" << mismatches << " COST MISMATCHES)";
+        cout << "\n";
+    }
+
+    // Ten alternative chains for a handful of the same pairs
+    const int yenQueries = 10;
+    int wrongBest = 0;
+    auto begin = Clock::now();
+    for (int i = 0; i < yenQueries; ++i) {
+        auto chains = rs.kShortestPaths(pairs[i].first, pairs[i].second, 10);
+        if ((chains.empty() ? -1 : chains[0].cost) != reference[i]) wrongBest++;
+    }
+    double ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+    cout << "Yen k=10: " << ms / yenQueries << " ms/query";
+    if (wrongBest) cout << "  (" << wrongBest << " COST MISMATCHES)";
+    cout << "\n";
+
+    // Random referral cost changes against four cached hot sources
+    const int updates = 2000;
+    rs.setHotSourceLimit(4);
+    for (int i = 0; i < 4; ++i)
+        for (int repeat = 0; repeat < 2; ++repeat) rs.fastestPathCost(pairs[i].first, 0);
+    uniform_int_distribution<int> cost(1, 100);
+    begin = Clock::now();
+    for (int i = 0; i < updates; ++i) {
+        int u = node(rng), v = u + 1 < rs.doctorCount() ? u + 1 : u - 1;
+        rs.updateReferralCost(rs.doctorName(u), rs.doctorName(v), cost(rng));
+    }
+    ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+    int stale = 0;
+    for (int i = 0; i < queries; ++i) {
+        int s = pairs[i % 4].first, t = pairs[i].second;
+        if (rs.fastestPathCost(s, t) != rs.fastestPathCost(s, t, nullptr, Mode::Dijkstra)) stale++;
+    }
+    cout << "Cached trees (" << rs.cachedSourceCount() << "): " << ms * 1000 / updates << " us/update";
+    if (stale) cout << "  (" << stale << " STALE ENTRIES)";
+    cout << "\n";
+}
+
+// Answers a batch of queries (random starts drawn from a pool of sources)
+// with 1 thread and with all hardware threads, and spot-checks the results
+// against single queries (run with: ./hospital --bench-batch [side] [queries])
+void runReferralBatchBenchmark(int side, int queries) {
+    using Clock = chrono::steady_clock;
+    ReferralSystem rs = buildReferralGrid(side, 11);
+    mt19937 rng(9);
+    uniform_int_distribution<int> node(0, rs.doctorCount() - 1);
+    vector<int> sources(max(1, queries / 100));
+    for (int& s : sources) s = node(rng);
+    uniform_int_distribution<int> pick(0, sources.size() - 1);
+    vector<pair<int, int>> batch(queries);
+    for (auto& q : batch) q = {sources[pick(rng)], node(rng)};
+
+    int hw = max(1u, thread::hardware_concurrency());
+    cout << "Referral batch benchmark: " << rs.doctorCount() << " doctors, " << queries
+         << " queries from " << sources.size() << " sources\n";
+    ReferralSystem::BatchResult result;
+    for (int threads : {1, hw}) {
+        auto start = Clock::now();
+        rs.solveBatch(batch, result, threads);
+        double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        cout << threads << " thread(s): " << ms << " ms (" << queries / ms * 1000 << " queries/s, "
+             << result.nodes.size() << " path nodes)\n";
+        if (hw == 1) break;
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < queries; i += max(1, queries / 50))
+        if (rs.fastestPathCost(batch[i].first, batch[i].second) != result.cost[i]) mismatches++;
+    if (mismatches) cout << mismatches << " COST MISMATCHES against single queries\n";
+}
+
+// Builds a dense single-hospital referral network (each doctor refers to
+// `fanout` random colleagues) and times the all-pairs precompute with both
+// methods, checking sampled entries against single queries
+// (run with: ./hospital --bench-allpairs [doctors])
+void runAllPairsBenchmark(int doctors) {
+    using Clock = chrono::steady_clock;
+    const int fanout = 64;
+    mt19937 rng(17);
+    uniform_int_distribution<int> node(0, doctors - 1), cost(1, 60);
+    vector<string> doctor(doctors);
+    for (int i = 0; i < doctors; ++i) doctor[i] = "Dr. " + to_string(i);
+    ReferralSystem rs;
+    for (int u = 0; u < doctors; ++u)
+        for (int k = 0; k < fanout; ++k) rs.addReferral(doctor[u], doctor[node(rng)], cost(rng));
+
+    cout << "All-pairs benchmark: " << doctors << " doctors, " << doctors * fanout << " referrals\n";
+    using Method = ReferralSystem::AllPairsMethod;
+    for (auto [method, label] : {pair<Method, const char*>{Method::FloydWarshall, "Blocked Floyd-Warshall"},
+                                 {Method::RepeatedDijkstra, "Repeated Dijkstra"}}) {
+        auto start = Clock::now();
+        rs.precomputeAllPairs(method);
+        double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        int mismatches = 0;
+        for (int i = 0; i < 200; ++i) {
+            int s = node(rng), t = node(rng);
+            if (rs.allPairsCost(s, t) != rs.fastestPathCost(s, t)) mismatches++;
+        }
+        cout << label << ": " << ms << " ms (" << (rs.allPairsNarrow() ? "16" : "32") << "-bit costs)";
+        if (mismatches) cout << "  (" << mismatches << " COST MISMATCHES)";
+        cout << "\n";
+    }
+
+    // Change the network after the precompute: the table must follow
+    rs.addReferral(doctor[0], "Dr. new", 1);
+    rs.addReferral("Dr. new", doctor[doctors - 1], 1);
+    for (int i = 0; i < 20; ++i) rs.updateReferralCost(doctor[node(rng)], doctor[node(rng)], 1);
+    int newId = rs.doctorId("Dr. new"), stale = 0;
+    for (int i = 0; i < 200; ++i) {
+        int s = i % 4 == 0 ? newId : node(rng), t = i % 4 == 1 ? newId : node(rng);
+        if (rs.allPairsCost(s, t) != rs.fastestPathCost(s, t)) stale++;
+    }
+    cout << "After network changes: " << (stale ? to_string(stale) + " STALE ANSWERS" : string("table matches Dijkstra")) << "\n";
+
+    long long checksum = 0;
+    auto start = Clock::now();
+    for (int s = 0; s <= doctors; ++s)
+        for (int t = 0; t <= doctors; ++t) checksum += rs.allPairsCost(s, t);
+    double ns = chrono::duration<double, nano>(Clock::now() - start).count() / ((double)(doctors + 1) * (doctors + 1));
+    cout << "Table lookup: " << ns << " ns/lookup (checksum " << checksum << ")\n";
+}
+
+// ============================
+// Benchmark: Treatment Planning
+// ============================
+
+// Enumerates every combination of n treatments in Gray-code order, keeping a
+// running cost per worker that changes by one treatment per step, and counts
+// the combinations within budget (run with: ./hospital --bench-treatments [n])
+void runTreatmentEnumerationBenchmark(int n) {
+    using Clock = chrono::steady_clock;
+    n = min(n, 40);
+    mt19937 rng(23);
+    uniform_int_distribution<int> price(50, 5000);
+    TreatmentPlanner tp;
+    vector<long long> cost(n);
+    long long budget = 0;
+    for (int i = 0; i < n; ++i) {
+        tp.addTreatment("Treatment" + to_string(i));
+        cost[i] = price(rng);
+        budget += cost[i];
+    }
+    budget /= 3;
+
+    // One cache line per worker so running totals do not false-share
+    struct alignas(64) WorkerState {
+        long long runningCost = 0;
+        long long withinBudget = 0;
+    };
+    int threads = max(1u, thread::hardware_concurrency());
+    vector<WorkerState> state(threads);
+
+    auto start = Clock::now();
+    tp.enumerateSubsets([&](int w, uint64_t mask, int changed) {
+        WorkerState& st = state[w];
+        if (changed < 0) {
+            st.runningCost = 0;
+            for (int i = 0; i < n; ++i)
+                if (mask >> i & 1) st.runningCost += cost[i];
+        } else {
+            st.runningCost += (mask >> changed & 1) ? cost[changed] : -cost[changed];
+        }
+        st.withinBudget += st.runningCost <= budget;
+    }, threads);
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    long long within = 0;
+    for (const auto& st : state) within += st.withinBudget;
+    double subsets = pow(2.0, n);
+    cout << "Treatment enumeration: " << n << " treatments, " << (long long)subsets << " combinations, "
+         << threads << " thread(s)\n";
+    cout << "Gray-code visitor: " << ms << " ms (" << subsets / ms / 1000 << " M combinations/s), "
+         << within << " within budget\n";
+}
+
+// Solves a random n-treatment planning instance: correlated costs and
+// benefits, ~n contraindicated pairs, 8 conditions of which 4 must be
+// covered, a budget of a third of the total cost and a duration cap
+// (run with: ./hospital --bench-optimizer [n])
+void runTreatmentOptimizerBenchmark(int n) {
+    using Clock = chrono::steady_clock;
+    n = min(n, TreatmentPlanner::MAX_TREATMENTS);
+    mt19937 rng(31);
+    uniform_int_distribution<int> price(100, 2000), noise(-150, 150), days(1, 30), condition(0, 7), pick(0, n - 1);
+    TreatmentPlanner tp;
+    TreatmentPlanner::PlanConstraints limits;
+    limits.budget = 0;
+    limits.maxDuration = 0;
+    for (int i = 0; i < n; ++i) {
+        int cost = price(rng), duration = days(rng);
+        uint64_t covers = uint64_t(1) << condition(rng) | uint64_t(1) << condition(rng);
+        tp.addTreatment("Treatment" + to_string(i), cost, max(1, cost / 10 + noise(rng)), duration, covers);
+        limits.budget += cost;
+        limits.maxDuration += duration;
+    }
+    for (int i = 0; i < n; ++i) {
+        int a = pick(rng), b = pick(rng);
+        if (a != b) tp.addIncompatibility(tp.treatmentName(a), tp.treatmentName(b));
+    }
+    limits.budget /= 3;
+    limits.maxDuration /= 2;
+    limits.requiredCoverage = 0x0F;
+
+    auto start = Clock::now();
+    TreatmentPlanner::TreatmentPlan plan = tp.optimizePlan(limits);
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    cout << "Treatment optimizer: " << n << " treatments, budget " << limits.budget << "\n";
+    cout << "Branch and bound: " << ms << " ms, ";
+    if (!plan.feasible) cout << "no feasible plan\n";
+    else cout << "benefit " << plan.benefit << ", cost " << plan.cost << ", " << plan.treatments.size() << " treatments\n";
+}
+
+// Best plan benefit over every subset of a small instance, or -1 if no
+// subset is feasible (the reference optimizePlan is checked against)
+long long bruteForcePlanBenefit(const vector<array<long long, 3>>& items, const vector<uint64_t>& covers,
+                                const vector<uint64_t>& conflicts, const TreatmentPlanner::PlanConstraints& limits) {
+    int n = items.size();
+    long long best = -1;
+    for (uint64_t mask = 0; mask < (uint64_t(1) << n); ++mask) {
+        long long cost = 0, benefit = 0, duration = 0;
+        uint64_t covered = 0;
+        bool ok = true;
+        for (int i = 0; i < n && ok; ++i) {
+            if (!(mask >> i & 1)) continue;
+            ok = !(conflicts[i] & mask);
+            cost += items[i][0];
+            benefit += items[i][1];
+            duration += items[i][2];
+            covered |= covers[i];
+        }
+        if (ok && cost <= limits.budget && duration <= limits.maxDuration &&
+            (covered & limits.requiredCoverage) == limits.requiredCoverage)
+            best = max(best, benefit);
+    }
+    return best;
+}
+
+// Compares optimizePlan with exhaustive search on small random instances,
+// some with free treatments and a zero budget, plus ten free treatments
+// under a zero budget (run with: ./hospital --bench-optimizer [n])
+void checkTreatmentOptimizer() {
+    mt19937 rng(37);
+    int mismatches = 0, trials = 300;
+    for (int trial = 0; trial <= trials; ++trial) {
+        bool regression = trial == trials;
+        int n = regression ? 10 : 1 + rng() % 12;
+        TreatmentPlanner tp;
+        TreatmentPlanner::PlanConstraints limits;
+        vector<array<long long, 3>> items(n);
+        vector<uint64_t> covers(n), conflicts(n, 0);
+        long long total = 0;
+        for (int i = 0; i < n; ++i) {
+            items[i] = regression ? array<long long, 3>{0, 10, 0}
+                                  : array<long long, 3>{rng() % 4 == 0 ? 0 : 1 + (long long)(rng() % 100),
+                                                        (long long)(rng() % 50), (long long)(rng() % 10)};
+            covers[i] = regression ? 0 : uint64_t(1) << rng() % 4;
+            tp.addTreatment("Treatment" + to_string(i), items[i][0], items[i][1], items[i][2], covers[i]);
+            total += items[i][0];
+        }
+        for (int k = 0; !regression && k < n / 3; ++k) {
+            int a = rng() % n, b = rng() % n;
+            if (a == b) continue;
+            tp.addIncompatibility(tp.treatmentName(a), tp.treatmentName(b));
+            conflicts[a] |= uint64_t(1) << b;
+            conflicts[b] |= uint64_t(1) << a;
+        }
+        limits.budget = regression || trial % 5 == 0 ? 0 : total / 2;
+        limits.maxDuration = regression ? 0 : 5 * n;
+        limits.requiredCoverage = regression ? 0 : rng() % 4;
+        TreatmentPlanner::TreatmentPlan plan = tp.optimizePlan(limits, 1 + trial % 2);
+        mismatches += (plan.feasible ? plan.benefit : -1) != bruteForcePlanBenefit(items, covers, conflicts, limits);
+    }
+    cout << "Brute-force check: " << trials + 1 << " instances, " << mismatches << " mismatches\n";
+}
+
+#ifdef HOSPITAL_HAS_COROUTINES
+// Streams the lazy combination generator: stops after the first few
+// three-treatment combinations, then consumes all 2^n combinations to time
+// the per-combination cost (run with: ./hospital --bench-generator [n])
+void runCombinationGeneratorBenchmark(int n) {
+    using Clock = chrono::steady_clock;
+    n = min(n, 40);
+    TreatmentPlanner tp;
+    for (int i = 0; i < n; ++i) tp.addTreatment("Treatment" + to_string(i));
+
+    cout << "First three-treatment combinations:\n";
+    int shown = 0;
+    for (span<const int> combo : tp.combinations()) {
+        if (combo.size() != 3) continue;
+        cout << "  ";
+        for (int id : combo) cout << tp.treatmentName(id) << " ";
+        cout << "\n";
+        if (++shown == 3) break;  // Early exit: the rest is never generated
+    }
+
+    long long combos = 0, members = 0;
+    auto start = Clock::now();
+    for (span<const int> combo : tp.combinations()) {
+        combos++;
+        members += combo.size();
+    }
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    cout << "Generator: " << combos << " combinations of " << n << " treatments in " << ms << " ms ("
+         << ms * 1e6 / combos << " ns/combination, " << members << " members)\n";
+}
+#endif
+
+// ============================
+// Benchmark: Patient Records
+// ============================
+
+// Loads `records` patient records, then runs front-desk reader threads doing
+// random lookups against one admissions thread updating records for a
+// second (run with: ./hospital --bench-records [readers] [records])
+void runRecordStoreBenchmark(int readers, int records) {
+    using Clock = chrono::steady_clock;
+    PatientRecordSystem prs;
+    vector<string> ids(records);
+    for (int i = 0; i < records; ++i) {
+        ids[i] = "P" + to_string(100000 + i);
+        prs.addRecord(ids[i], "Patient " + to_string(i) + " - Checkup " + to_string(2000 + i % 25));
+    }
+
+    atomic<bool> stop{false};
+    atomic<long long> reads{0}, writes{0}, bytes{0};
+    vector<thread> pool;
+    for (int r = 0; r < readers; ++r)
+        pool.emplace_back([&, r] {
+            mt19937 rng(r);
+            uniform_int_distribution<int> pick(0, records - 1);
+            long long n = 0, seen = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                auto record = prs.findRecord(ids[pick(rng)]);
+                seen += record ? record->size() : 0;
+                n++;
+            }
+            reads += n;
+            bytes += seen;
+        });
+    pool.emplace_back([&] {
+        mt19937 rng(99);
+        uniform_int_distribution<int> pick(0, records - 1);
+        long long n = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            int i = pick(rng);
+            prs.addRecord(ids[i], "Patient " + to_string(i) + " - Surgery 2024");
+            n++;
+        }
+        writes += n;
+    });
+    auto start = Clock::now();
+    this_thread::sleep_for(chrono::seconds(1));
+    stop = true;
+    for (auto& t : pool) t.join();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << "Record store benchmark: " << records << " records, " << readers << " reader(s) + 1 writer\n";
+    cout << "Reads:  " << reads / seconds / 1e6 << " M/s (" << bytes << " bytes seen)\n";
+    cout << "Writes: " << writes / seconds / 1e6 << " M/s\n";
+}
+
+// Bulk-loads `records` sorted patient records into a B+ tree file, reopens
+// it, then times hot random point lookups, copy-on-write updates with a
+// durable flush, and a reopen that checks the updates survived
+// (run with: ./hospital --bench-btree [records] [path])
+void runBPlusTreeBenchmark(int records, const string& path) {
+    using Clock = chrono::steady_clock;
+    auto idOf = [](int i) { return "P" + to_string(1000000 + i); };
+    auto seconds = [](Clock::time_point since) { return chrono::duration<double>(Clock::now() - since).count(); };
+    remove(path.c_str());
+
+    auto start = Clock::now();
+    {
+        BPlusTreeStore tree(path);
+        int i = 0;
+        tree.bulkLoad([&](string& id, string& record) {
+            if (i == records) return false;
+            id = idOf(i);
+            record = "Patient " + to_string(i) + " - Checkup " + to_string(2000 + i % 25);
+            i++;
+            return true;
+        });
+    }
+    cout << "B+ tree benchmark: " << records << " records in " << path << "\n";
+    cout << "Bulk load: " << seconds(start) * 1000 << " ms\n";
+
+    PatientRecordSystem prs(make_unique<BPlusTreeStore>(path));
+    mt19937 rng(7);
+    uniform_int_distribution<int> pick(0, records - 1);
+    const int lookups = 1000000;
+    vector<string> probes(lookups);
+    for (auto& id : probes) id = idOf(pick(rng));
+    string warm;
+    for (int i = 0; i < records; i += 64) warm = prs.searchRecord(idOf(i));  // Fault the mapping in
+    size_t bytes = 0;
+    start = Clock::now();
+    for (const auto& id : probes) bytes += prs.searchRecord(id).size();
+    cout << "Hot lookups: " << seconds(start) / lookups * 1e6 << " us avg (" << bytes << " bytes)\n";
+
+    const int updates = 100000;
+    start = Clock::now();
+    for (int u = 0; u < updates; ++u) {
+        int i = pick(rng);
+        prs.addRecord(idOf(i), "Patient " + to_string(i) + " - Surgery 2024");
+    }
+    prs.addRecord(idOf(records), "Patient " + to_string(records) + " - Admission 2024");
+    prs.flush();
+    cout << "Updates: " << updates << " + flush in " << seconds(start) * 1000 << " ms\n";
+
+    PatientRecordSystem reopened(make_unique<BPlusTreeStore>(path));
+    bool ok = reopened.recordCount() == (size_t)records + 1 &&
+              reopened.searchRecord(idOf(records)) == "Patient " + to_string(records) + " - Admission 2024";
+    for (int i = 0; i < records && ok; i += max(1, records / 1000)) ok = reopened.searchRecord(idOf(i)) == prs.searchRecord(idOf(i));
+    cout << "Reopen check: " << (ok ? "ok" : "MISMATCH") << "\n";
+}
+
+// Streams `updates` random record updates over `records` patients into an
+// LSM store (lab-integration write load), then times random lookups, a
+// durable flush, and a reopen that checks the newest values survived
+// (run with: ./hospital --bench-lsm [updates] [records] [directory])
+// The directory is deleted first, so it may only hold LSM store files
+void runLSMBenchmark(int updates, int records, const string& directory) {
+    using Clock = chrono::steady_clock;
+    auto idOf = [](int i) { return "P" + to_string(1000000 + i); };
+    auto seconds = [](Clock::time_point since) { return chrono::duration<double>(Clock::now() - since).count(); };
+    error_code error;
+    if (filesystem::exists(directory) && !filesystem::is_directory(directory))
+        throw runtime_error("refusing to delete " + directory + ": not a directory");
+    if (filesystem::is_directory(directory))
+        for (const auto& entry : filesystem::directory_iterator(directory)) {
+            string name = entry.path().filename().string();
+            if (name.rfind("MANIFEST", 0) != 0 && name.rfind("wal-", 0) != 0 && name.rfind("run-", 0) != 0)
+                throw runtime_error("refusing to delete " + directory + ": " + name + " is not an LSM store file");
+        }
+    filesystem::remove_all(directory, error);
+    if (error) throw runtime_error("cannot remove " + directory + ": " + error.message());
+
+    vector<int> latest(records, -1);
+    mt19937 rng(11);
+    uniform_int_distribution<int> pick(0, records - 1);
+    {
+        PatientRecordSystem prs(make_unique<LSMStore>(directory));
+        auto start = Clock::now();
+        for (int u = 0; u < updates; ++u) {
+            int i = pick(rng);
+            latest[i] = u;
+            prs.addRecord(idOf(i), "Patient " + to_string(i) + " - Lab result " + to_string(u));
+        }
+        prs.flush();
+        double elapsed = seconds(start);
+        cout << "LSM benchmark: " << updates << " updates over " << records << " records in " << directory << "\n";
+        cout << "Writes: " << updates / elapsed / 1000 << " K/s (" << elapsed * 1e6 / updates << " us avg, durable at flush)\n";
+
+        const int lookups = 200000;
+        size_t found = 0;
+        start = Clock::now();
+        for (int q = 0; q < lookups; ++q) found += prs.findRecord(idOf(pick(rng))) != nullptr;
+        cout << "Lookups: " << seconds(start) / lookups * 1e6 << " us avg (" << found << " found)\n";
+    }
+
+    LSMStore reopened(directory);
+    bool ok = true;
+    string record;
+    for (int i = 0; i < records && ok; i += max(1, records / 1000))
+        ok = latest[i] < 0 ? !reopened.get(idOf(i), record)
+                           : reopened.get(idOf(i), record) && record == "Patient " + to_string(i) + " - Lab result " + to_string(latest[i]);
+    cout << "Levels: " << reopened.describeLevels() << "\n";
+    cout << "Reopen check: " << (ok ? "ok" : "MISMATCH") << "\n";
+}
+
+// Loads `records` patient records, then compares index-backed queries
+// (all visits in one year, an ID range, a name prefix) with a full scan of
+// the store (run with: ./hospital --bench-index [records])
+void runRecordIndexBenchmark(int records) {
+    using Clock = chrono::steady_clock;
+    auto seconds = [](Clock::time_point since) { return chrono::duration<double>(Clock::now() - since).count(); };
+    const vector<string> firstNames = {"John", "Jane", "Maria", "Wei", "Amir", "Olga", "Kenji", "Lucia"};
+    const vector<string> lastNames = {"Doe", "Smith", "Garcia", "Chen", "Khan", "Ivanova", "Sato", "Rossi"};
+    const vector<string> visits = {"Checkup", "Surgery", "Lab work", "Follow-up"};
+    PatientRecordSystem prs(PatientRecordSystem::Indexing::Fields);
+    mt19937 rng(5);
+    auto start = Clock::now();
+    for (int i = 0; i < records; ++i)
+        prs.addRecord("P" + to_string(1000000 + i), firstNames[rng() % 8] + " " + lastNames[rng() % 8] + " - " +
+                                                         visits[rng() % 4] + " " + to_string(2000 + rng() % 25));
+    cout << "Record index benchmark: " << records << " records\n";
+    cout << "Load with indexes: " << seconds(start) * 1000 << " ms\n";
+    start = Clock::now();
+    prs.visitsInYear(2000);  // First query merges the pending entries
+    cout << "First query (merges pending index entries): " << seconds(start) * 1000 << " ms\n";
+
+    auto timeQuery = [&](const string& label, auto&& indexed, auto&& matches) {
+        auto begin = Clock::now();
+        size_t found = indexed().size();
+        double fast = seconds(begin);
+        begin = Clock::now();
+        size_t scanned = 0;
+        PatientFields fields;
+        prs.scanRecords([&](const string& id, const string& record) { scanned += matches(id, record, fields); });
+        double slow = seconds(begin);
+        cout << label << ": " << found << " ids in " << fast * 1000 << " ms (full scan " << slow * 1000 << " ms, "
+             << scanned << " ids)\n";
+    };
+    timeQuery("Visits in 2023", [&] { return prs.visitsInYear(2023); },
+              [](const string&, const string& record, PatientFields& f) { return parsePatientRecord(record, f) && f.year == 2023; });
+    timeQuery("IDs P1000100-P1000199", [&] { return prs.recordsInRange("P1000100", "P1000199"); },
+              [](const string& id, const string&, PatientFields&) { return id >= "P1000100" && id <= "P1000199"; });
+    timeQuery("Names starting \"Wei C\"", [&] { return prs.patientsNamed("Wei C", true); },
+              [](const string&, const string& record, PatientFields& f) { return parsePatientRecord(record, f) && f.name.compare(0, 5, "Wei C") == 0; });
+}
+
+// Loads `records` patient records with free-text notes, then compares
+// ranked full-text queries against a scan that tokenizes every record
+// (run with: ./hospital --bench-text [records])
+void runTextSearchBenchmark(int records) {
+    using Clock = chrono::steady_clock;
+    auto seconds = [](Clock::time_point since) { return chrono::duration<double>(Clock::now() - since).count(); };
+    const vector<string> names = {"John Doe", "Jane Smith", "Maria Garcia", "Wei Chen", "Amir Khan", "Olga Ivanova"};
+    const vector<string> visits = {"Checkup", "Surgery", "Lab work", "Follow-up", "X-ray", "Vaccination"};
+    const vector<string> notes = {"knee", "cardiac", "fracture", "allergy", "fever", "routine", "chronic", "pain",
+                                  "pediatric", "diabetes", "asthma", "migraine"};
+    PatientRecordSystem prs(PatientRecordSystem::Indexing::Full);
+    mt19937 rng(6);
+    size_t rawBytes = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < records; ++i) {
+        string record = names[rng() % names.size()] + " - " + visits[rng() % visits.size()] + " " + to_string(2000 + rng() % 25);
+        for (int n = rng() % 4; n > 0; --n) record += " " + notes[rng() % notes.size()];
+        rawBytes += record.size();
+        prs.addRecord("P" + to_string(1000000 + i), record);
+    }
+    cout << "Text search benchmark: " << records << " records (" << rawBytes / 1048576.0 << " MiB of text)\n";
+    cout << "Load with indexes: " << seconds(start) * 1000 << " ms, postings " << prs.textIndex().postingBytes() / 1048576.0 << " MiB\n";
+
+    for (const string query : {"surgery", "surgery 2023", "cardiac surgery 2023", "wei chen knee fracture"}) {
+        auto begin = Clock::now();
+        auto hits = prs.searchText(query, 10);
+        double fast = seconds(begin);
+        vector<string> terms = TextIndex::tokenize(query);
+        size_t scanned = 0;
+        begin = Clock::now();
+        prs.scanRecords([&](const string&, const string& record) {
+            vector<string> tokens = TextIndex::tokenize(record);
+            scanned += all_of(terms.begin(), terms.end(), [&](const string& t) { return find(tokens.begin(), tokens.end(), t) != tokens.end(); });
+        });
+        double slow = seconds(begin);
+        cout << "\"" << query << "\": " << scanned << " matches, top " << (hits.empty() ? string("-") : hits[0].id) << " in "
+             << fast * 1000 << " ms (full scan " << slow * 1000 << " ms)\n";
+    }
+}
+
+// Keeps an admissions thread rewriting every record in ID order (pass N
+// stamps "rev N") while a report iterates a pinned snapshot; a consistent
+// snapshot sees one prefix of IDs at rev N + 1 and the rest at rev N
+// (run with: ./hospital --bench-snapshot [records])
+void runSnapshotBenchmark(int records) {
+    using Clock = chrono::steady_clock;
+    auto seconds = [](Clock::time_point since) { return chrono::duration<double>(Clock::now() - since).count(); };
+    PatientRecordSystem prs;
+    auto idOf = [](int i) { return "P" + to_string(1000000 + i); };
+    for (int i = 0; i < records; ++i) prs.addRecord(idOf(i), "Patient " + to_string(i) + " - Checkup rev 0");
+
+    atomic<bool> stop{false};
+    atomic<long long> writes{0};
+    thread admissions([&] {
+        for (int pass = 1; !stop.load(memory_order_relaxed); ++pass)
+            for (int i = 0; i < records && !stop.load(memory_order_relaxed); ++i) {
+                prs.addRecord(idOf(i), "Patient " + to_string(i) + " - Checkup rev " + to_string(pass));
+                writes.fetch_add(1, memory_order_relaxed);
+            }
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(200));
+    auto start = Clock::now();
+    long long writesBefore = writes.load();
+    vector<int> rev(records, -1);
+    size_t seen = 0, kept = 0;
+    {
+        auto snapshot = prs.snapshot();
+        snapshot.forEach([&](const string& id, const string& record) {
+            rev[stoi(id.substr(1)) - 1000000] = stoi(record.substr(record.rfind(' ') + 1));
+            seen++;
+        });
+        kept = prs.historyVersions();
+    }
+    double scan = seconds(start);
+    long long writesDuring = writes.load() - writesBefore;
+    bool consistent = seen == (size_t)records && rev[0] - rev[records - 1] <= 1 && is_sorted(rev.begin(), rev.end(), greater<int>());
+    this_thread::sleep_for(chrono::milliseconds(300));  // Let the collector run
+    size_t left = prs.historyVersions();
+    stop = true;
+    admissions.join();
+
+    cout << "Snapshot benchmark: " << records << " records, 1 admissions writer\n";
+    cout << "Snapshot scan: " << scan * 1000 << " ms, " << seen << " records, "
+         << (consistent ? "consistent" : "INCONSISTENT") << " (revs " << rev[records - 1] << ".." << rev[0] << ")\n";
+    cout << "Writes during the scan: " << writesDuring << " (" << kept << " old versions kept for the snapshot)\n";
+    cout << "Old versions after release and collection: " << left << "\n";
+}
+
 // ============================
 // Main Function to Demonstrate Classes
 // ============================
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--bench-referrals") {
+        runReferralQueryBenchmark(argc > 2 ? atoi(argv[2]) : 500);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-allpairs") {
+        runAllPairsBenchmark(argc > 2 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-treatments") {
+        runTreatmentEnumerationBenchmark(argc > 2 ? atoi(argv[2]) : 25);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-optimizer") {
+        runTreatmentOptimizerBenchmark(argc > 2 ? atoi(argv[2]) : 60);
+        checkTreatmentOptimizer();
+        return 0;
+    }
+#ifdef HOSPITAL_HAS_COROUTINES
+    if (argc > 1 && string(argv[1]) == "--bench-generator") {
+        runCombinationGeneratorBenchmark(argc > 2 ? atoi(argv[2]) : 22);
+        return 0;
+    }
+#endif
+    if (argc > 1 && string(argv[1]) == "--bench-records") {
+        runRecordStoreBenchmark(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-btree") {
+        runBPlusTreeBenchmark(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? argv[3] : "patients.btree");
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-lsm") {
+        runLSMBenchmark(argc > 2 ? atoi(argv[2]) : 2000000, argc > 3 ? atoi(argv[3]) : 500000, argc > 4 ? argv[4] : "patients-lsm");
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-index") {
+        runRecordIndexBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-text") {
+        runTextSearchBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-snapshot") {
+        runSnapshotBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-batch") {
+        runReferralBatchBenchmark(argc > 2 ? atoi(argv[2]) : 300, argc > 3 ? atoi(argv[3]) : 20000);
+        return 0;
+    }
+
     // Demonstrate hospital organizational structure management
     HospitalStructure hs;
     hs.addWorkUnit("Cardiology", "HeartTeamA", {"Dr. A", "Nurse B"});
@@ -214,10 +4428,16 @@ int main() {
     hs.displayStructure();
 
     // Demonstrate patient record management system
-    PatientRecordSystem prs;
+    PatientRecordSystem prs(PatientRecordSystem::Indexing::Full);
     prs.addRecord("P123", "John Doe - Checkup 2023");
     prs.addRecord("P456", "Jane Smith - Surgery 2022");
     cout << "Search record P123: " << prs.searchRecord("P123") << endl;
+    cout << "Patients seen in 2022:";
+    for (const string& id : prs.visitsInYear(2022)) cout << " " << id;
+    cout << endl;
+    cout << "Records mentioning surgery:";
+    for (const auto& hit : prs.searchText("surgery")) cout << " " << hit.id;
+    cout << endl;
 
     // Demonstrate referral network and optimal pathfinding
     ReferralSystem rs;
@@ -226,6 +4446,9 @@ int main() {
     rs.addReferral("Dr. A", "Dr. D", 10);   // Alternative path with higher cost
     rs.addReferral("Dr. D", "Dr. C", 1);    // Cheaper final step
     rs.findFastestPath("Dr. A", "Dr. C");   // Find optimal A->C path
+    rs.findAlternativePaths("Dr. A", "Dr. C", 3);  // Ranked alternatives if a doctor is unavailable
+    rs.updateReferralCost("Dr. B", "Dr. C", 9);    // Dr. C is booked up: referrals via B now take longer
+    rs.findFastestPath("Dr. A", "Dr. C");          // Answered from the incrementally repaired cache
 
     // Demonstrate treatment combination analysis
     TreatmentPlanner tp;
@@ -233,5 +4456,15 @@ int main() {
     vector<string> path;
     tp.dfsCombinations(treatments, path, 0);  // Generate all treatment combinations
 
+    // Demonstrate constrained treatment plan optimization
+    tp.addTreatment("Med1", 100, 30, 7, 0b01);       // Cost, benefit, days, conditions covered
+    tp.addTreatment("TherapyA", 300, 50, 30, 0b10);
+    tp.addTreatment("SurgeryX", 900, 120, 2, 0b11);
+    tp.addIncompatibility("Med1", "SurgeryX");       // Contraindicated together
+    TreatmentPlanner::PlanConstraints limits;
+    limits.budget = 1000;
+    limits.requiredCoverage = 0b11;
+    tp.recommendPlan(limits);
+
     return 0;
 }